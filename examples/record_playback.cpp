@@ -1,189 +1,85 @@
-#include <fstream>
+// Records a few seconds of the selected input channel with the Recorder subsystem, then plays
+// the recording back through the default output device and lists any discontinuity markers.
+//
+// Usage: record_playback [device name hint] [seconds] [file]
+#include <chrono>
 #include <iostream>
-#include "portaudio.h"
+#include <string>
+#include <thread>
+#include <vector>
 
-#define PA_SAMPLE_TYPE paInt16
-typedef short SAMPLE;
+#include "audio_engine.h"
+#include "portaudio.h"
+#include "recorder.h"
 
 using std::cout, std::endl;
 
-typedef struct bufData {
-    SAMPLE* recording;
-    int frameIndex;
-    int maxFrameIndex;
-} recordingData;
-
-static int paRecordCallback(const void *inputBuffer, void *outputBuffer,
-                     unsigned long framesPerBuffer,
-                     const PaStreamCallbackTimeInfo *timeInfo,
-                     PaStreamCallbackFlags statusFlags,
-                     void *userData) {
-    recordingData *data = (recordingData*)userData;
-    const SAMPLE *rptr = (const SAMPLE*)inputBuffer;
-    SAMPLE *wptr = &data->recording[data->frameIndex * 2];
-    unsigned long framesLeft = data->maxFrameIndex - data->frameIndex;
-    unsigned long framesToCalc;
-    int finished = paContinue;
-
-    if (framesLeft < framesPerBuffer) {
-        framesToCalc= framesLeft; // Prevent overflow
-        finished = paComplete;
-    } else {
-        framesToCalc = framesPerBuffer; // Process all requested frames
-        finished = paContinue;
-    }
-
-    if (inputBuffer == NULL) {
-        for (unsigned long i = 0; i < framesToCalc; i++) {
-            *wptr++ = 0; // Zero out the output buffer
-            *wptr++ = 0;
-        }
-    } else {
-        for (unsigned long i = 0; i < framesToCalc; i++) {
-            *wptr++ = *rptr++; // Copy input to output
-            *wptr++ = *rptr++;
-        }
-    }
-
-    data->frameIndex += framesToCalc;
-    return finished;
-}
-
-static int paPlayCallback(const void *inputBuffer, void *outputBuffer,
-                     unsigned long framesPerBuffer,
-                     const PaStreamCallbackTimeInfo *timeInfo,
-                     PaStreamCallbackFlags statusFlags,
-                     void *userData) {
-    recordingData *data = (recordingData*)userData;
-    SAMPLE *rptr = &data->recording[data->frameIndex * 2];
-    SAMPLE *wptr = (SAMPLE*)outputBuffer;
-    unsigned long framesLeft = data->maxFrameIndex - data->frameIndex;
-
-    int finished = paContinue;
-
-    if (framesLeft < framesPerBuffer) {
-        for (unsigned long i = 0; i < framesLeft; i++) {
-            *wptr++ = *rptr++; // Copy remaining recorded data to output
-            *wptr++ = *rptr++;
-        }
-        // Zero out the rest of the output buffer if not enough frames
-        for (unsigned long i = framesLeft; i < framesPerBuffer; i++) {
-            *wptr++ = 0; // Zero out the output buffer
-            *wptr++ = 0;
-        }
-        data->frameIndex += framesLeft;
-        finished = paComplete; // Mark as complete if no more frames left
-    }
-
-    for (unsigned long i = 0; i < framesPerBuffer; i++) {
-        *wptr++ = *rptr++; // Copy recorded data to output
-        *wptr++ = *rptr++;
-    }
-    data->frameIndex += framesPerBuffer;
-
-    return finished;
-}
-
-int main() {
-    PaError err = Pa_Initialize();
-    if (err != paNoError) {
-        cout << "PortAudio error: " << Pa_GetErrorText(err) << endl;
-    } else {
-        cout << "PortAudio terminated successfully." << endl;
-    }
-
-    /* ------------ RECORD AUDIO -------------*/
-
-    int record_time = 5; 
-
-    PaDeviceIndex device_in = 3;
-    const PaDeviceInfo *deviceInfo = Pa_GetDeviceInfo(device_in);
-    cout << "Using device: " << deviceInfo->name << endl;
-
-    recordingData data;
-    data.frameIndex = 0;
-    data.maxFrameIndex = record_time * deviceInfo->defaultSampleRate;
-    int numSamples = data.maxFrameIndex * 2; 
-    int numBytes = numSamples * sizeof(SAMPLE);
-    data.recording = (SAMPLE*) malloc(numBytes);
-    for (int i = 0; i < numSamples; i++) {
-        data.recording[i] = 0; // Initialize recording buffer
-    }
-
-    PaStreamParameters recordParameters;
-    recordParameters.device = device_in;
-    recordParameters.channelCount = 2;
-    recordParameters.sampleFormat = PA_SAMPLE_TYPE;
-    recordParameters.suggestedLatency = deviceInfo->defaultLowInputLatency;
-    recordParameters.hostApiSpecificStreamInfo = NULL;
-
-    PaStream *inStream;
-    err = Pa_OpenStream(&inStream, &recordParameters, NULL,
-                        deviceInfo->defaultSampleRate, 256, paClipOff,
-                        paRecordCallback, &data);
-
-    if (err != paNoError) {
-        goto done;
+int main(int argc, char* argv[]) {
+  const std::string deviceName = argc > 1 ? argv[1] : "Scarlett";
+  const int recordSeconds = argc > 2 ? std::stoi(argv[2]) : 5;
+  const std::string path = argc > 3 ? argv[3] : "session.gtrc";
+
+  /* ------------ RECORD AUDIO -------------*/
+  {
+    Recorder recorder{};  // Must outlive the stream
+    AudioEngine engine{};
+    if (!engine.init(deviceName) || !engine.openStream()) {
+      cout << "Could not open input device" << endl;
+      return -1;
     }
 
-    err = Pa_StartStream(inStream);
-    if (err != paNoError) {
-        goto done;
+    if (!recorder.open(path, engine.getSampleRate(), engine.getChannelCount(),
+                       engine.getConfig().analysisWindow)) {
+      return -1;
     }
+    engine.setRecorder(&recorder);
 
-    cout << "Recording for " << record_time << " seconds..." << endl;
-    while( Pa_IsStreamActive(inStream) == 1 ) {
-        Pa_Sleep(1000); // Sleep for 1 second
-    }
+    cout << "Recording " << recordSeconds << " seconds to " << path << "..." << endl;
+    engine.start();
+    std::this_thread::sleep_for(std::chrono::seconds(recordSeconds));
+    engine.stop();
+    recorder.close();
     cout << "Recording complete." << endl;
-
-    err = Pa_CloseStream(inStream);
-    if (err != paNoError) goto done;
-
-    /* --------------- PLAYBACK OF RECORDED AUDIO --------------*/
-    data.frameIndex = 0; // Reset frame index for playback
-    PaStream *playbackStream;
-    PaStreamParameters playbackParameters;
-    playbackParameters.device = Pa_GetDefaultOutputDevice();
-    playbackParameters.channelCount = 2;
-    playbackParameters.sampleFormat = PA_SAMPLE_TYPE;
-    playbackParameters.suggestedLatency = deviceInfo->defaultLowOutputLatency;
-    playbackParameters.hostApiSpecificStreamInfo = NULL;
-
-    err = Pa_OpenStream(&playbackStream, NULL, &playbackParameters, deviceInfo->defaultSampleRate, 256, paClipOff,
-                        paPlayCallback, &data);
-
-    if (err != paNoError) {
-        goto done;
-    }
-
+  }
+
+  /* --------------- PLAYBACK OF RECORDED AUDIO --------------*/
+  RecordingReader reader{};
+  if (!reader.open(path)) {
+    return -1;
+  }
+  const RecordingHeader& header = reader.getHeader();
+
+  PaError err = Pa_Initialize();
+  if (err != paNoError) {
+    cout << "PortAudio error: " << Pa_GetErrorText(err) << endl;
+    return -1;
+  }
+
+  PaStream* playbackStream;
+  err = Pa_OpenDefaultStream(&playbackStream, 0, header.channelCount, paFloat32, header.sampleRate,
+                             header.blockFrames, NULL, NULL);
+  if (err == paNoError) {
     err = Pa_StartStream(playbackStream);
-    if (err != paNoError) {
-        goto done;
-    }
-    cout << "Playing back recorded audio..." << endl;
-    while( (err = Pa_IsStreamActive(playbackStream)) == 1 ) {
-        Pa_Sleep(100);
+  }
+
+  if (err == paNoError) {
+    cout << "Playing back " << reader.blockCount() << " blocks..." << endl;
+    RecordingBlockHeader block{};
+    std::vector<float> samples;
+    for (size_t i = 0; i < reader.blockCount() && reader.readBlock(i, block, samples); ++i) {
+      if (block.flags != 0) {
+        cout << "  block " << i << " at " << block.adcTime << " s has flags " << block.flags
+             << endl;
+      }
+      Pa_WriteStream(playbackStream, samples.data(), block.frameCount);
     }
+    Pa_StopStream(playbackStream);
+    Pa_CloseStream(playbackStream);
     cout << "Playback complete." << endl;
-    err = Pa_CloseStream(playbackStream);
-    if (err != paNoError) goto done;
+  } else {
+    cout << "PortAudio error: " << Pa_GetErrorText(err) << endl;
+  }
 
-done:
-    free(data.recording);
-    if( err != paNoError )
-    {
-        fprintf( stderr, "An error occured while using the portaudio stream\n" );
-        fprintf( stderr, "Error number: %d\n", err );
-        fprintf( stderr, "Error message: %s\n", Pa_GetErrorText( err ) );
-    }
-
-    err = Pa_Terminate();
-    if (err != paNoError) {
-        cout << "PortAudio error: " << Pa_GetErrorText(err) << endl;
-    } else {
-        cout << "PortAudio terminated successfully." << endl;
-    }
-
-    return 0;
-}
\ No newline at end of file
+  Pa_Terminate();
+  return 0;
+}
@@ -0,0 +1,190 @@
+// Evaluates polyphonic string detection on synthetic strums fed through ChannelAnalyzer, the
+// same path the live callback uses. Prints the hit rate per scenario and exits with a non-zero
+// status if the in-tune standard strum regression case fails.
+//
+// Usage: string_detection_eval [trials]
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <numbers>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "analyzer.h"
+#include "freq_analysis.h"
+
+using std::cout, std::endl;
+
+namespace {
+
+constexpr int SAMPLE_RATE{48000};
+constexpr unsigned long BLOCK_SIZE{4096};
+constexpr float TOLERANCE_CENTS{5.0f};
+
+struct StringTone {
+  bool played;
+  float detuneCents;
+  float amplitude;
+};
+
+struct Strum {
+  std::vector<StringTone> strings;
+  unsigned partials;
+  float inharmonicity;  // Partial h sits at h * f0 * sqrt(1 + B * h^2)
+};
+
+struct Score {
+  unsigned played{0};
+  unsigned correct{0};    // Found within TOLERANCE_CENTS of the played pitch
+  unsigned wrong{0};      // Found, but further off
+  unsigned missed{0};
+  unsigned falseHits{0};  // Found although not played
+  std::vector<unsigned> failuresByString;  // Any of the above, indexed like the tuning
+};
+
+// Runs one strum through a fresh analyzer and scores the strings of the last block
+Score evaluate(const Tuning& tuning, const Strum& strum, std::mt19937& rng, bool verbose) {
+  std::uniform_real_distribution<float> phaseDistribution(0.0f, 2.0f * std::numbers::pi_v<float>);
+
+  struct Partial {
+    double frequency;
+    float amplitude;
+    float phase;
+  };
+  std::vector<Partial> partials;
+  for (size_t s = 0; s < tuning.strings.size(); ++s) {
+    const StringTone& tone = strum.strings[s];
+    if (!tone.played) continue;
+    const double f0 = midiToFreq(tuning.strings[s]) * std::pow(2.0, tone.detuneCents / 1200.0);
+    for (unsigned h = 1; h <= strum.partials; ++h) {
+      const double frequency = f0 * h * std::sqrt(1.0 + strum.inharmonicity * h * h);
+      if (frequency >= SAMPLE_RATE / 2.0) break;
+      partials.push_back({frequency, tone.amplitude / h, phaseDistribution(rng)});
+    }
+  }
+
+  // Enough blocks to fill the polyphonic history
+  ChannelAnalyzer analyzer{SAMPLE_RATE, tuning};
+  analyzer.setPolyphonic(true);
+  AudioBlock block(BLOCK_SIZE);
+  unsigned long n = 0;
+  for (unsigned long filled = 0; filled < paddedSize; filled += BLOCK_SIZE) {
+    for (float& sample : block) {
+      double value = 0.0;
+      for (const Partial& partial : partials) {
+        value += partial.amplitude *
+                 std::sin(2.0 * std::numbers::pi * partial.frequency * n / SAMPLE_RATE +
+                          partial.phase);
+      }
+      sample = static_cast<float>(value);
+      ++n;
+    }
+    analyzer.process(block, BLOCK_SIZE);
+  }
+
+  Score score{};
+  score.failuresByString.assign(tuning.strings.size(), 0);
+  const std::vector<StringResult>& results = analyzer.getStrings();
+  for (size_t s = 0; s < results.size(); ++s) {
+    const StringTone& tone = strum.strings[s];
+    const StringResult& result = results[s];
+    if (!tone.played) {
+      score.falseHits += result.found;
+      score.failuresByString[s] += result.found;
+    } else {
+      ++score.played;
+      if (!result.found) {
+        ++score.missed;
+        ++score.failuresByString[s];
+      } else if (std::abs(result.cents - tone.detuneCents) <= TOLERANCE_CENTS) {
+        ++score.correct;
+      } else {
+        ++score.wrong;
+        ++score.failuresByString[s];
+      }
+    }
+    if (verbose) {
+      cout << "  " << result.target.name << result.target.octave << " played " << tone.played
+           << " at " << tone.detuneCents << " cents, found " << result.found << " at "
+           << result.cents << " cents" << endl;
+    }
+  }
+  return score;
+}
+
+void add(Score& total, const Score& score) {
+  total.played += score.played;
+  total.correct += score.correct;
+  total.wrong += score.wrong;
+  total.missed += score.missed;
+  total.falseHits += score.falseHits;
+  total.failuresByString.resize(score.failuresByString.size());
+  for (size_t s = 0; s < score.failuresByString.size(); ++s) {
+    total.failuresByString[s] += score.failuresByString[s];
+  }
+}
+
+void print(const std::string& name, const Tuning& tuning, const Score& score) {
+  cout << name << ": " << score.correct << "/" << score.played << " within " << TOLERANCE_CENTS
+       << " cents, " << score.wrong << " off, " << score.missed << " missed, " << score.falseHits
+       << " false";
+  for (size_t s = 0; s < score.failuresByString.size(); ++s) {
+    if (score.failuresByString[s] > 0) {
+      const NoteInfo note = freqToNote(midiToFreq(tuning.strings[s]));
+      cout << ", " << note.name << note.octave << " failed " << score.failuresByString[s];
+    }
+  }
+  cout << endl;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const unsigned trials = argc > 1 ? std::stoul(argv[1]) : 200;
+  const Tuning& tuning = *findTuning("standard");
+  const size_t stringCount = tuning.strings.size();
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> amplitude(0.3f, 1.0f);
+
+  // Regression case: every string exactly in tune with purely harmonic partials, so B3 and E4
+  // sit exactly on partials of E2 and A2. Only the partial phases differ between strums
+  cout << "In tune standard strum" << endl;
+  const Strum inTune{std::vector<StringTone>(stringCount, {true, 0.0f, 1.0f}), 8, 0.0f};
+  Score regression = evaluate(tuning, inTune, rng, true);
+  for (unsigned trial = 1; trial < trials / 5; ++trial) {
+    add(regression, evaluate(tuning, inTune, rng, false));
+  }
+  print("in tune", tuning, regression);
+
+  // Guitar that is already close to pitch, the most common case when checking a tuning. Every
+  // other strum only plays a random subset of the strings, which catches false detections on
+  // partials of the lower strings
+  Score closeScore{};
+  std::uniform_real_distribution<float> close(-1.5f, 1.5f);
+  for (unsigned trial = 0; trial < trials / 2; ++trial) {
+    Strum strum{{}, 8, 0.0f};
+    for (size_t s = 0; s < stringCount; ++s) {
+      const bool played = trial % 2 == 0 || rng() % 3 != 0;
+      strum.strings.push_back({played, close(rng), amplitude(rng)});
+    }
+    add(closeScore, evaluate(tuning, strum, rng, false));
+  }
+  print("close to pitch", tuning, closeScore);
+
+  // Out of tune strums with slightly inharmonic partials. Every fourth strum plays all strings,
+  // the others a random subset
+  Score detunedScore{};
+  std::uniform_real_distribution<float> detune(-20.0f, 20.0f);
+  for (unsigned trial = 0; trial < trials; ++trial) {
+    Strum strum{{}, 10, 0.0001f};
+    for (size_t s = 0; s < stringCount; ++s) {
+      const bool played = trial % 4 == 0 || rng() % 3 != 0;
+      strum.strings.push_back({played, detune(rng), amplitude(rng)});
+    }
+    add(detunedScore, evaluate(tuning, strum, rng, false));
+  }
+  print("detuned", tuning, detunedScore);
+
+  return regression.correct == regression.played && regression.falseHits == 0 ? 0 : 1;
+}
@@ -0,0 +1,101 @@
+#include "analyzer.h"
+
+#include <algorithm>
+
+#include "metrics.h"
+
+namespace {
+
+constexpr int MIDI_C2{36};
+constexpr int MIDI_C8{108};  // ~4186 Hz, top of the constant-Q range
+
+// C at or below the lowest string, with at least a whole tone of margin for detuned strings
+int lowestMidi(const Tuning& tuning) {
+  if (tuning.strings.empty()) return MIDI_C2;
+  const int lowest = *std::ranges::min_element(tuning.strings) - 2;
+  return std::min(MIDI_C2, lowest - ((lowest % 12) + 12) % 12);
+}
+
+// Every string of the tuning, none of them found
+std::vector<StringResult> silentStrings(const Tuning& tuning) {
+  std::vector<StringResult> results(tuning.strings.size());
+  for (size_t s = 0; s < results.size(); ++s) {
+    results[s].target = freqToNote(midiToFreq(tuning.strings[s]));
+    results[s].detected = freqToNote(0.0f);
+  }
+  return results;
+}
+
+}  // namespace
+
+ChannelAnalyzer::ChannelAnalyzer(int sampleRate, const Tuning& tuning)
+    : sampleRate(sampleRate),
+      tuning(tuning),
+      gate(sampleRate),
+      constantQ(sampleRate, midiToFreq(lowestMidi(tuning)), (MIDI_C8 - lowestMidi(tuning)) / 12),
+      history(paddedSize, 0.0f),
+      note(freqToNote(0.0f)) {}
+
+bool ChannelAnalyzer::process(AudioBlock& block, unsigned long blockSize) {
+  {
+    ScopedStageTimer timer{Stage::Gate};
+    const bool wasOpen = gate.isOpen();
+    if (!gate.process(block.data(), blockSize)) {
+      Metrics::increment(Metrics::instance().blocksGated);
+
+      // Gated samples count as zeros, so the transform and history start from silence again
+      if (wasOpen) {
+        constantQ.reset();
+        std::fill(history.begin(), history.end(), 0.0f);
+        note = freqToNote(0.0f);
+      }
+
+      const bool modeChanged = polyphonic == strings.empty();
+      if (modeChanged) {
+        strings = polyphonic ? silentStrings(tuning) : std::vector<StringResult>{};
+      }
+      return wasOpen || modeChanged;
+    }
+  }
+
+  // Keep the history current in both modes so switching is seamless. Analysis windows longer
+  // than the history only keep their most recent samples
+  const unsigned long kept = std::min<unsigned long>(blockSize, history.size());
+  std::shift_left(history.begin(), history.end(), kept);
+  std::copy_n(block.begin() + (blockSize - kept), kept, history.end() - kept);
+
+  {
+    ScopedStageTimer timer{Stage::Transform};
+    constantQ.process(block.data(), blockSize);
+  }
+
+  if (polyphonic) {
+    if (!linearSpectrum) {
+      linearSpectrum = std::make_unique<FFTData>();
+    }
+
+    {
+      // Window a copy, the history must stay untouched for the next blocks
+      ScopedStageTimer timer{Stage::Window};
+      scratch = history;
+      hannWindow(scratch.data(), scratch.size());
+    }
+
+    {
+      ScopedStageTimer timer{Stage::Transform};
+      fft(scratch.data(), scratch.size(), *linearSpectrum);
+    }
+  }
+
+  {
+    ScopedStageTimer timer{Stage::PeakSearch};
+    note = freqToNote(findPeakFrequency(constantQ.getSpectrum()));
+
+    if (polyphonic) {
+      strings = detectStrings(*linearSpectrum, scratch.size(), sampleRate, tuning);
+    } else {
+      strings.clear();
+    }
+  }
+  return true;
+}
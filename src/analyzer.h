@@ -0,0 +1,48 @@
+#pragma once
+#include <memory>
+#include <vector>
+
+#include "audio_engine.h"
+#include "constant_q.h"
+#include "freq_analysis.h"
+#include "noise_gate.h"
+
+// Detector state for a single input channel. An instance is only ever used by one thread at a
+// time, the AudioEngine never runs two blocks of the same channel concurrently.
+class ChannelAnalyzer {
+ public:
+  // The constant-Q range starts at the C below the lowest string of the tuning
+  ChannelAnalyzer(int sampleRate, const Tuning& tuning);
+
+  // In polyphonic mode every string of the tuning is resolved separately. That needs a finer
+  // resolution around the low strings than the constant-Q transform has, so the strings are
+  // searched in a linear FFT over the last paddedSize samples instead
+  void setPolyphonic(bool enabled) { polyphonic = enabled; }
+
+  // Runs the gate, transform and peak search over one block. Returns whether there are new
+  // results to publish: blocks below the noise gate skip the analysis, only the first one after
+  // the gate closed (or a mode switch while silent) produces the silent result
+  bool process(AudioBlock& block, unsigned long blockSize);
+
+  bool isSilent() const { return !gate.isOpen(); }
+
+  const NoteInfo& getNote() const { return note; }
+
+  // Per string results of the last block, empty unless polyphonic
+  const std::vector<StringResult>& getStrings() const { return strings; }
+
+  // Constant-Q spectrum of the latest samples, valid until the next call to process()
+  const LogSpectrum& getSpectrum() const { return constantQ.getSpectrum(); }
+
+ private:
+  int sampleRate;
+  const Tuning& tuning;
+  bool polyphonic{false};
+  NoiseGate gate;
+  ConstantQ constantQ;
+  std::vector<float> history;  // Most recent paddedSize samples, oldest first
+  std::vector<float> scratch;
+  std::unique_ptr<FFTData> linearSpectrum;  // Only allocated once polyphonic mode is used
+  NoteInfo note{};
+  std::vector<StringResult> strings;
+};
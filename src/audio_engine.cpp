@@ -1,11 +1,17 @@
 #include "audio_engine.h"
 
+#include <algorithm>
+#include <bit>
 #include <chrono>
 #include <iostream>
+#include <numeric>
+#include <stop_token>
 #include <string>
 
+#include "metrics.h"
 #include "pa_ringbuffer.h"
 #include "portaudio.h"
+#include "thread_pool.h"
 
 bool AudioEngine::init(std::string deviceNameHint) {
   PaError err = Pa_Initialize();
@@ -19,9 +25,8 @@ bool AudioEngine::init(std::string deviceNameHint) {
     return false;
   }
 
-  if (PaUtil_InitializeRingBuffer(&ringBuffer, sizeof(SAMPLE), RING_BUFFER_SIZE,
-                                  ringBufferData.data()) < 0) {
-    std::cout << "Could not initialize ring buffer" << std::endl;
+  const int defaultChannel = getDeviceInfo()->maxInputChannels > 1 ? 1 : 0;
+  if (!setInputChannels({defaultChannel})) {
     return false;
   }
 
@@ -29,6 +34,110 @@ bool AudioEngine::init(std::string deviceNameHint) {
   return true;
 }
 
+bool AudioEngine::initReplay(const std::string& path, ReplayPace pace) {
+  replayReader = std::make_unique<RecordingReader>();
+  if (!replayReader->open(path)) {
+    return false;
+  }
+
+  // Analyze every recorded channel unless told otherwise
+  std::vector<int> channels(replayReader->getHeader().channelCount);
+  std::iota(channels.begin(), channels.end(), 0);
+
+  replayPace = pace;
+  config.analysisWindow = replayReader->getHeader().analysisWindow;
+  return setInputChannels(channels);
+}
+
+bool AudioEngine::setInputChannels(const std::vector<int>& channels) {
+  const int available = replayReader ? static_cast<int>(replayReader->getHeader().channelCount)
+                                     : getDeviceInfo()->maxInputChannels;
+  if (channels.empty()) {
+    std::cout << "At least one input channel must be selected" << std::endl;
+    return false;
+  }
+  for (int channel : channels) {
+    if (channel < 0 || channel >= available) {
+      std::cout << "Input channel " << channel << " out of range, " << available
+                << " channels available" << std::endl;
+      return false;
+    }
+  }
+
+  inputChannels = channels;
+  return true;
+}
+
+bool AudioEngine::setConfig(const AudioConfig& newConfig) {
+  if (newConfig.framesPerBuffer == 0) {
+    std::cout << "Buffer size must not be 0" << std::endl;
+    return false;
+  }
+  if (newConfig.sampleRate < 0.0) {
+    std::cout << "Invalid sample rate " << newConfig.sampleRate << std::endl;
+    return false;
+  }
+  if (replayReader && newConfig.sampleRate > 0.0 &&
+      newConfig.sampleRate != replayReader->getHeader().sampleRate) {
+    std::cout << "Replay runs at the recorded sample rate of "
+              << replayReader->getHeader().sampleRate << " Hz" << std::endl;
+  }
+
+  config = newConfig;
+  if (config.analysisWindow == 0) {
+    // Replays analyze the same blocks as the recorded session did
+    config.analysisWindow =
+        replayReader ? replayReader->getHeader().analysisWindow : DEFAULT_ANALYSIS_WINDOW;
+  }
+  return true;
+}
+
+unsigned long AudioEngine::getRingCapacity() const {
+  if (config.ringCapacity > 0) {
+    return std::bit_ceil(config.ringCapacity);
+  }
+  // One window being filled, one waiting for a worker and one of scheduling slack
+  const unsigned long writeFrames =
+      replayReader ? replayReader->getHeader().blockFrames : config.framesPerBuffer;
+  return std::bit_ceil(3 * config.analysisWindow + 2 * writeFrames);
+}
+
+bool AudioEngine::createChannelRings() {
+  const unsigned long capacity = getRingCapacity();
+  const unsigned long writeFrames =
+      replayReader ? replayReader->getHeader().blockFrames : config.framesPerBuffer;
+  if (capacity < config.analysisWindow + writeFrames) {
+    std::cout << "Ring capacity " << capacity << " cannot hold an analysis window of "
+              << config.analysisWindow << " plus a buffer of " << writeFrames << " frames"
+              << std::endl;
+    return false;
+  }
+
+  channelRings.clear();
+  for (size_t i = 0; i < inputChannels.size(); ++i) {
+    auto channel = std::make_unique<ChannelRing>();
+    channel->data.assign(capacity, 0.0f);
+    channel->block.assign(config.analysisWindow, 0.0f);
+    if (PaUtil_InitializeRingBuffer(&channel->ring, sizeof(SAMPLE), capacity,
+                                    channel->data.data()) < 0) {
+      std::cout << "Could not initialize ring buffer" << std::endl;
+      return false;
+    }
+    channelRings.push_back(std::move(channel));
+  }
+  return true;
+}
+
+double AudioEngine::getSampleRate() {
+  if (replayReader) {
+    return replayReader->getHeader().sampleRate;
+  }
+  if (config.sampleRate > 0.0) {
+    return config.sampleRate;
+  }
+  return getDeviceInfo()->defaultSampleRate;
+}
+
 int AudioEngine::findDevice(std::string deviceNameHint) {
   int deviceCount = Pa_GetDeviceCount();
   for (int i = 0; i < deviceCount; i++) {
@@ -44,79 +153,283 @@ bool AudioEngine::openStream() {
   if (inStream) {
     return true;
   }
+  if (!createChannelRings()) {
+    return false;
+  }
+  if (replayReader) {
+    return true;
+  }
   const PaDeviceInfo* deviceInfo = Pa_GetDeviceInfo(deviceIndex);
+  const double sampleRate = getSampleRate();
 
+  // Only open as many channels as needed to reach the highest selected one
   inStreamParameters.device = deviceIndex;
-  inStreamParameters.channelCount = deviceInfo->maxInputChannels;
+  inStreamParameters.channelCount = *std::ranges::max_element(inputChannels) + 1;
   inStreamParameters.sampleFormat = PA_SAMPLE_TYPE;
   inStreamParameters.suggestedLatency = deviceInfo->defaultLowInputLatency;
   inStreamParameters.hostApiSpecificStreamInfo = NULL;
   std::cout << "default sample rate: " << deviceInfo->defaultSampleRate << std::endl;
 
-  PaError err =
-      Pa_OpenStream(&inStream, &inStreamParameters, NULL, deviceInfo->defaultSampleRate,
-                    SAMPLES_PER_CALLBACK, paClipOff, &AudioEngine::paRecordCallback, this);
+  if (Pa_IsFormatSupported(&inStreamParameters, NULL, sampleRate) != paFormatIsSupported) {
+    std::cout << "Sample rate " << sampleRate << " Hz is not supported by the device"
+              << std::endl;
+    return false;
+  }
+
+  captureBuffer.assign(config.framesPerBuffer * inputChannels.size(), 0.0f);
+  ringDropped.assign(inputChannels.size(), 0);
+  chunkDropped.assign(inputChannels.size(), 0);
+
+  PaError err = Pa_OpenStream(&inStream, &inStreamParameters, NULL, sampleRate,
+                              config.framesPerBuffer, paClipOff, &AudioEngine::paRecordCallback,
+                              this);
   if (err != paNoError) {
     std::cout << Pa_GetErrorText(err);
     return false;
   }
 
+  std::cout << "sample rate: " << sampleRate << ", buffer: " << config.framesPerBuffer
+            << " frames, analysis window: " << config.analysisWindow
+            << ", ring: " << getRingCapacity() << std::endl;
+
   return true;
 }
 
 bool AudioEngine::start() {
-  audioThread = std::jthread([this]() {
-    while (audioThread.get_stop_token().stop_requested() == false) {
-      std::array<SAMPLE, SAMPLES_PER_CALLBACK> tempBuffer;
-      if (PaUtil_GetRingBufferReadAvailable(&ringBuffer) >= SAMPLES_PER_CALLBACK) {
-        PaUtil_ReadRingBuffer(&ringBuffer, tempBuffer.data(),
-                              SAMPLES_PER_CALLBACK * sizeof(SAMPLE));
-        if (audioCallback) {
-          audioCallback(tempBuffer, SAMPLES_PER_CALLBACK,
-                        static_cast<int>(getDeviceInfo()->defaultSampleRate));
-        }
-      } else {
-        std::this_thread::sleep_for(std::chrono::milliseconds(2));
-      }
-    }
-  });
+  const int sampleRate = static_cast<int>(getSampleRate());
+  audioThread = std::jthread(
+      [this, sampleRate](std::stop_token stopToken) { analysisLoop(stopToken, sampleRate); });
+
+  if (replayReader) {
+    replayActive = true;
+    replayThread = std::jthread([this](std::stop_token stopToken) { replayLoop(stopToken); });
+    return true;
+  }
 
   return inStream && Pa_StartStream(inStream) == paNoError;
 }
 
 bool AudioEngine::stop() {
+  if (replayThread.joinable()) {
+    replayThread.request_stop();
+    replayThread.join();
+  }
   if (audioThread.joinable()) {
     audioThread.request_stop();
     audioThread.join();
   }
+  if (replayReader) {
+    return true;
+  }
   return inStream && Pa_StopStream(inStream) == paNoError;
 }
 
-bool AudioEngine::isActive() { return inStream && Pa_IsStreamActive(inStream) == 1; }
+bool AudioEngine::isActive() {
+  if (replayReader) {
+    return replayActive;
+  }
+  return inStream && Pa_IsStreamActive(inStream) == 1;
+}
+
+// Hands every full block to the thread pool. A channel only gets its next block once the
+// previous one is done, so per channel detector state never needs locking
+void AudioEngine::analysisLoop(std::stop_token stopToken, int sampleRate) {
+  const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+  ThreadPool pool{std::min(cores, getChannelCount())};
+  const ring_buffer_size_t window = config.analysisWindow;
+  const std::stop_callback wakeOnStop{stopToken, [this] { wakeAnalysis(); }};
+
+  while (!stopToken.stop_requested()) {
+    // Read before checking the rings, a wakeup in between makes the wait below return at once
+    const uint32_t wakeups = analysisWakeups.load(std::memory_order_acquire);
+    bool dispatched = false;
+    for (unsigned i = 0; i < channelRings.size(); ++i) {
+      ChannelRing& channel = *channelRings[i];
+      if (channel.busy.load(std::memory_order_acquire) ||
+          PaUtil_GetRingBufferReadAvailable(&channel.ring) < window) {
+        continue;
+      }
+
+      PaUtil_ReadRingBuffer(&channel.ring, channel.block.data(), window);
+      channel.busy.store(true, std::memory_order_relaxed);
+      dispatched = true;
+
+      pool.submit([this, &channel, i, window, sampleRate] {
+        if (audioCallback) {
+          audioCallback(i, channel.block, window, sampleRate);
+        }
+        channel.busy.store(false, std::memory_order_release);
+        wakeAnalysis();  // The ring may have filled up meanwhile
+      });
+    }
+
+    if (!dispatched) {
+      analysisWakeups.wait(wakeups, std::memory_order_acquire);
+    }
+  }
+}
+
+void AudioEngine::wakeAnalysis() {
+  analysisWakeups.fetch_add(1, std::memory_order_release);
+  analysisWakeups.notify_one();
+}
+
+unsigned long AudioEngine::writeChannelRing(unsigned channel, const SAMPLE* samples,
+                                            unsigned long frames, unsigned stride) {
+  PaUtilRingBuffer* ring = &channelRings[channel]->ring;
+  void* regions[2];
+  ring_buffer_size_t sizes[2];
+  const ring_buffer_size_t writable = PaUtil_GetRingBufferWriteRegions(
+      ring, frames, &regions[0], &sizes[0], &regions[1], &sizes[1]);
+
+  // Deinterleave straight into the ring memory
+  for (int r = 0; r < 2; ++r) {
+    SAMPLE* wptr = static_cast<SAMPLE*>(regions[r]);
+    for (ring_buffer_size_t i = 0; i < sizes[r]; ++i) {
+      *wptr++ = *samples;
+      samples += stride;
+    }
+  }
+  PaUtil_AdvanceRingBufferWriteIndex(ring, writable);
+
+  // Only wake the analysis thread once there is a window to read, not on every device buffer
+  if (PaUtil_GetRingBufferReadAvailable(ring) >=
+      static_cast<ring_buffer_size_t>(config.analysisWindow)) {
+    wakeAnalysis();
+  }
+
+  const unsigned long dropped = frames - static_cast<unsigned long>(writable);
+  if (dropped > 0) {
+    Metrics::increment(Metrics::instance().ringOverruns, dropped);
+  }
+  return dropped;
+}
+
+// Pushes the recorded samples into the channel rings exactly as paRecordCallback would, so the
+// analysis thread cannot tell a replay from a live session
+void AudioEngine::replayLoop(std::stop_token stopToken) {
+  const RecordingHeader& header = replayReader->getHeader();
+  RecordingBlockHeader block{};
+  std::vector<float> samples;
+  std::vector<RecordingDrop> drops;
+  const auto startTime = std::chrono::steady_clock::now();
 
-// This function is kind of tailored to my focusrite scarlett 2i2 which has 2 input channels
-// where channel 0 is mic input and channel 1 is instrument input, so i skip channel 0
+  auto ringsHaveSpace = [this](unsigned long frames) {
+    return std::ranges::all_of(channelRings, [frames](const auto& channel) {
+      return PaUtil_GetRingBufferWriteAvailable(&channel->ring) >=
+             static_cast<ring_buffer_size_t>(frames);
+    });
+  };
+
+  for (size_t i = 0; i < replayReader->blockCount() && !stopToken.stop_requested(); ++i) {
+    if (!replayReader->readBlock(i, block, samples, &drops)) {
+      std::cout << "Could not read recording block " << i << std::endl;
+      break;
+    }
+
+    if (block.flags != 0) {
+      std::cout << "Replay: discontinuity (flags " << block.flags << ") at frame "
+                << block.firstFrame << std::endl;
+    }
+
+    if (replayPace == ReplayPace::Realtime) {
+      // A block is only complete once its last frame would have been captured
+      const std::chrono::duration<double> blockEnd{(block.firstFrame + block.frameCount) /
+                                                   header.sampleRate};
+      std::this_thread::sleep_until(
+          startTime + std::chrono::duration_cast<std::chrono::steady_clock::duration>(blockEnd));
+    } else {
+      // Never drop samples when running ahead of the analysis, the result must be reproducible
+      while (!ringsHaveSpace(block.frameCount) && !stopToken.stop_requested()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    }
+
+    // Running ahead never overruns the rings, so each channel replays its recorded overruns
+    for (unsigned c = 0; c < channelRings.size(); ++c) {
+      const float* channelSamples = samples.data() + inputChannels[c];
+      unsigned long position = 0;
+      if (replayPace == ReplayPace::AsFastAsPossible) {
+        const RecordingDrop* channelDrops = drops.data() + inputChannels[c] * RECORDING_MAX_DROPS;
+        for (unsigned d = 0; d < RECORDING_MAX_DROPS && channelDrops[d].count > 0; ++d) {
+          writeChannelRing(c, channelSamples + position * header.channelCount,
+                           channelDrops[d].offset - position, header.channelCount);
+          position = channelDrops[d].offset + channelDrops[d].count;
+          Metrics::increment(Metrics::instance().ringOverruns, channelDrops[d].count);
+        }
+      }
+      writeChannelRing(c, channelSamples + position * header.channelCount,
+                       block.frameCount - position, header.channelCount);
+    }
+  }
+
+  std::cout << "Replay finished" << std::endl;
+  replayActive = false;
+}
+
+// Copies each selected device channel into its own ring. Channel 1 is selected by default, which
+// is the instrument input on my focusrite scarlett 2i2 (channel 0 is the mic input)
 int AudioEngine::paRecordCallback(const void* inputBuffer, [[maybe_unused]] void* outputBuffer,
                                   unsigned long framesPerBuffer,
-                                  [[maybe_unused]] const PaStreamCallbackTimeInfo* timeInfo,
-                                  [[maybe_unused]] PaStreamCallbackFlags statusFlags,
-                                  void* userData) {
+                                  const PaStreamCallbackTimeInfo* timeInfo,
+                                  PaStreamCallbackFlags statusFlags, void* userData) {
+  ScopedStageTimer timer{Stage::Capture};
+  Metrics& metrics = Metrics::instance();
+  if (statusFlags & paInputOverflow) Metrics::increment(metrics.inputOverflows);
+  if (statusFlags & paInputUnderflow) Metrics::increment(metrics.inputUnderflows);
+
   AudioEngine* self = static_cast<AudioEngine*>(userData);
-  const SAMPLE* rptr = static_cast<const SAMPLE*>(inputBuffer);
-  // Temporary buffer to store correct channel samples before writing to ring buffer
-  std::vector<SAMPLE> tempBuffer(framesPerBuffer);
-  SAMPLE* wptr = tempBuffer.data();
-  for (unsigned long i = 0; i < SAMPLES_PER_CALLBACK; i++) {
-    rptr++;             // Skip first channel
-    *wptr++ = *rptr++;  // Copy input to output
+  const SAMPLE* input = static_cast<const SAMPLE*>(inputBuffer);
+  if (!input) {
+    return paContinue;
   }
 
-  PaUtil_WriteRingBuffer(self->getRingBuffer(), tempBuffer.data(), framesPerBuffer);
+  const unsigned deviceChannels = self->inStreamParameters.channelCount;
+  const unsigned channelCount = self->getChannelCount();
+  const unsigned long frames = framesPerBuffer;
+
+  // Every ring drops the tail of the buffer, each by its own amount
+  for (unsigned c = 0; c < channelCount; ++c) {
+    self->ringDropped[c] =
+        self->writeChannelRing(c, input + self->inputChannels[c], frames, deviceChannels);
+  }
+
+  if (self->recorder) {
+    uint32_t recordFlags = 0;
+    if (statusFlags & paInputOverflow) recordFlags |= RECORDING_FLAG_INPUT_OVERFLOW;
+    if (statusFlags & paInputUnderflow) recordFlags |= RECORDING_FLAG_INPUT_UNDERFLOW;
+
+    // Preallocated buffer with only the selected channels, still interleaved. It holds the
+    // requested buffer size, larger buffers are recorded in several chunks
+    const unsigned long chunkFrames = self->captureBuffer.size() / channelCount;
+    for (unsigned long start = 0; start < frames; start += chunkFrames) {
+      const unsigned long count = std::min(chunkFrames, frames - start);
+      SAMPLE* wptr = self->captureBuffer.data();
+      for (unsigned long i = start; i < start + count; i++) {
+        for (unsigned c = 0; c < channelCount; ++c) {
+          *wptr++ = input[i * deviceChannels + self->inputChannels[c]];
+        }
+      }
+
+      const double adcTime =
+          timeInfo->inputBufferAdcTime + start / self->recorder->getSampleRate();
+      for (unsigned c = 0; c < channelCount; ++c) {
+        const unsigned long firstDropped = frames - self->ringDropped[c];
+        self->chunkDropped[c] = start + count - std::clamp(firstDropped, start, start + count);
+      }
+      self->recorder->write(self->captureBuffer.data(), count, adcTime,
+                            start == 0 ? recordFlags : 0, self->chunkDropped.data());
+    }
+  }
 
   return paContinue;
 }
 
 AudioEngine::~AudioEngine() {
+  // Worker threads reference the channel rings, make sure they are gone first
+  replayThread = {};
+  audioThread = {};
+
   if (inStream) {
     Pa_StopStream(inStream);
     Pa_CloseStream(inStream);
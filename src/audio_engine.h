@@ -1,24 +1,63 @@
 #pragma once
-#include <array>
+#include <atomic>
 #include <functional>
+#include <memory>
 #include <thread>
+#include <vector>
 
 #include "pa_ringbuffer.h"
 #include "portaudio.h"
+#include "recorder.h"
 
-constexpr unsigned RING_BUFFER_SIZE{16384};
-constexpr unsigned SAMPLES_PER_CALLBACK{4096};
 constexpr unsigned PA_SAMPLE_TYPE{paFloat32};
 
 using SAMPLE = float;
+using AudioBlock = std::vector<SAMPLE>;  // Always AudioConfig::analysisWindow samples
+
+constexpr unsigned long DEFAULT_ANALYSIS_WINDOW{4096};
+
+// Capture and analysis sizes are independent: small device buffers keep the input latency and
+// jitter low while the analysis still sees long windows
+struct AudioConfig {
+  double sampleRate{0.0};              // 0 uses the device default, replays use the recorded rate
+  unsigned long framesPerBuffer{256};  // Frames per PortAudio callback
+  unsigned long analysisWindow{0};     // 0 uses DEFAULT_ANALYSIS_WINDOW, replays the recorded one
+  unsigned long ringCapacity{0};       // Samples per channel ring, 0 sizes it automatically
+};
+
+// Called from the analysis thread pool with the index of the channel (position in
+// getInputChannels()) the block belongs to. Blocks of the same channel never run concurrently.
 using audioCallback_t =
-    std::function<void(std::array<SAMPLE, SAMPLES_PER_CALLBACK> buffer, unsigned long, int)>;
+    std::function<void(unsigned channel, AudioBlock& buffer, unsigned long, int)>;
+
+enum class ReplayPace { Realtime, AsFastAsPossible };
 
 struct AudioEngine {
   bool init(std::string deviceNameHint);
 
+  // Feeds a recording into the analysis pipeline instead of capturing from a device
+  bool initReplay(const std::string& path, ReplayPace pace);
+
   static int findDevice(std::string deviceNameHint);
 
+  // Selects which device channels (or recorded channels when replaying) are analyzed. Defaults
+  // to the second input if there is one, the instrument input on Focusrite Scarlett interfaces.
+  // Must be called before openStream()
+  bool setInputChannels(const std::vector<int>& channels);
+
+  // Must be called before openStream()
+  bool setConfig(const AudioConfig& newConfig);
+
+  const AudioConfig& getConfig() const { return config; }
+
+  // Ring capacity in use: AudioConfig::ringCapacity rounded up to a power of two, or room for
+  // three analysis windows and two device buffers if not set
+  unsigned long getRingCapacity() const;
+
+  const std::vector<int>& getInputChannels() const { return inputChannels; }
+
+  unsigned getChannelCount() const { return static_cast<unsigned>(inputChannels.size()); }
+
   bool openStream();
 
   bool start();
@@ -29,10 +68,13 @@ struct AudioEngine {
 
   const PaDeviceInfo* getDeviceInfo() { return Pa_GetDeviceInfo(deviceIndex); }
 
-  PaUtilRingBuffer* getRingBuffer() { return &ringBuffer; }
+  double getSampleRate();
 
   void setAudioCallback(audioCallback_t callback) { audioCallback = callback; }
 
+  // Captured samples are also streamed to the recorder. Set before start()
+  void setRecorder(Recorder* newRecorder) { recorder = newRecorder; }
+
   ~AudioEngine();
 
  private:
@@ -40,10 +82,45 @@ struct AudioEngine {
   int deviceIndex = -1;
   PaStream* inStream{nullptr};
   PaStreamParameters inStreamParameters{};
-  std::array<SAMPLE, RING_BUFFER_SIZE> ringBufferData{};
+  AudioConfig config{.analysisWindow = DEFAULT_ANALYSIS_WINDOW};
   std::jthread audioThread;
   audioCallback_t audioCallback;
-  PaUtilRingBuffer ringBuffer{};
+
+  // Each analyzed channel has its own ring so channels can be processed independently
+  struct ChannelRing {
+    std::vector<SAMPLE> data;
+    PaUtilRingBuffer ring{};
+    AudioBlock block;               // Block currently handed to the analysis callback
+    std::atomic<bool> busy{false};  // Set while a worker is processing `block`
+  };
+  std::vector<int> inputChannels;
+  std::vector<std::unique_ptr<ChannelRing>> channelRings;
+
+  // Bumped whenever the analysis thread may have work: a ring holds a full window, a worker
+  // finished or a stop was requested. The analysis thread waits on it instead of polling
+  std::atomic<uint32_t> analysisWakeups{0};
+  void wakeAnalysis();
+
+  std::vector<SAMPLE> captureBuffer;  // Selected channels of the callback, interleaved
+  std::vector<unsigned long> ringDropped;   // Per channel, tail of the callback its ring dropped
+  std::vector<unsigned long> chunkDropped;  // Same, for the part handed to the recorder
+  Recorder* recorder{nullptr};
+
+  std::unique_ptr<RecordingReader> replayReader;
+  ReplayPace replayPace{ReplayPace::Realtime};
+  std::atomic<bool> replayActive{false};
+  std::jthread replayThread;
+
+  bool createChannelRings();
+
+  // Copies one channel out of interleaved samples into its ring. Returns the number of samples
+  // that did not fit
+  unsigned long writeChannelRing(unsigned channel, const SAMPLE* samples, unsigned long frames,
+                                 unsigned stride);
+
+  void analysisLoop(std::stop_token stopToken, int sampleRate);
+
+  void replayLoop(std::stop_token stopToken);
 
   static int paRecordCallback(const void* inputBuffer, void* outputBuffer,
                               unsigned long framesPerBuffer,
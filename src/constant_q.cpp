@@ -0,0 +1,176 @@
+#include "constant_q.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+
+namespace {
+
+// Keeps the last frame.size() samples of the concatenation of frame and input
+void appendToFrame(std::vector<float>& frame, std::span<const float> input) {
+  if (input.size() >= frame.size()) {
+    std::copy(input.end() - frame.size(), input.end(), frame.begin());
+    return;
+  }
+  std::shift_left(frame.begin(), frame.end(), input.size());
+  std::copy(input.begin(), input.end(), frame.end() - input.size());
+}
+
+// Drops the octaves reaching above Nyquist, low sample rates cannot represent them
+unsigned octavesBelowNyquist(double sampleRate, float minFreq, unsigned octaveCount) {
+  while (octaveCount > 1 && minFreq * std::pow(2.0, octaveCount) > sampleRate / 2.0) {
+    --octaveCount;
+  }
+  return std::max(1u, octaveCount);
+}
+
+}  // namespace
+
+ConstantQ::HalfBandDecimator::HalfBandDecimator() {
+  // Blackman windowed sinc with the cutoff at a quarter of the input rate
+  const int center = TAP_COUNT / 2;
+  for (int n = 0; n < static_cast<int>(TAP_COUNT); ++n) {
+    const int offset = n - center;
+    if (offset != 0 && offset % 2 == 0) {
+      continue;  // Exactly zero for a half-band filter
+    }
+    const double x = std::numbers::pi * offset / 2.0;
+    const double sinc = offset == 0 ? 1.0 : std::sin(x) / x;
+    const double phase = 2.0 * std::numbers::pi * n / (TAP_COUNT - 1);
+    const double window = 0.42 - 0.5 * std::cos(phase) + 0.08 * std::cos(2.0 * phase);
+    taps.emplace_back(n, static_cast<float>(0.5 * sinc * window));
+  }
+
+  // Normalize for unity gain at DC
+  float sum = 0.0f;
+  for (const auto& [index, value] : taps) sum += value;
+  for (auto& [index, value] : taps) value /= sum;
+
+  reset();
+}
+
+void ConstantQ::HalfBandDecimator::reset() {
+  buffer.assign(TAP_COUNT - 1, 0.0f);
+  skipNext = false;
+}
+
+void ConstantQ::HalfBandDecimator::process(std::span<const float> input,
+                                           std::vector<float>& output) {
+  buffer.insert(buffer.end(), input.begin(), input.end());
+  output.clear();
+
+  for (size_t start = 0; start + TAP_COUNT <= buffer.size(); ++start) {
+    if (!skipNext) {
+      float sum = 0.0f;
+      for (const auto& [index, value] : taps) {
+        sum += buffer[start + index] * value;
+      }
+      output.push_back(sum);
+    }
+    skipNext = !skipNext;
+  }
+
+  buffer.erase(buffer.begin(), buffer.end() - (TAP_COUNT - 1));
+}
+
+ConstantQ::ConstantQ(double sampleRate, float minFreq, unsigned octaveCount)
+    : octaveCount(octavesBelowNyquist(sampleRate, minFreq, octaveCount)) {
+  spectrum.minFreq = minFreq;
+  spectrum.binsPerOctave = BINS_PER_OCTAVE;
+  spectrum.magnitudes.assign(this->octaveCount * BINS_PER_OCTAVE, 0.0f);
+
+  // Halve the rate of the top octave while its highest bin stays below 38% of the rate, which
+  // is what the half-band decimators keep free of aliasing
+  const float topMinFreq = minFreq * std::pow(2.0f, this->octaveCount - 1);
+  const float maxFreq = 2.0f * topMinFreq;
+  double topRate = sampleRate;
+  preDecimation = 0;
+  while (maxFreq <= 0.38 * topRate / 2.0) {
+    topRate /= 2.0;
+    ++preDecimation;
+  }
+
+  preDecimators.resize(preDecimation);
+  preBuffers.resize(preDecimation);
+  octaves.resize(this->octaveCount);
+  for (Octave& octave : octaves) {
+    octave.frame.assign(FRAME_SIZE, 0.0f);
+  }
+  fftBuffer.resize(FRAME_SIZE);
+
+  buildKernel(topRate, topMinFreq);
+}
+
+// Brown & Puckette's sparse kernel: the spectrum of each Hann windowed complex exponential,
+// with negligible entries dropped. Kernels are right aligned in the frame so every bin looks at
+// the most recent samples. By Parseval, sum(x[n] * conj(k[n])) == sum(X[m] * conj(K[m])) / N
+void ConstantQ::buildKernel(double topRate, float topMinFreq) {
+  kernel.resize(BINS_PER_OCTAVE);
+  std::vector<std::complex<float>> temporal(FRAME_SIZE);
+
+  for (unsigned bin = 0; bin < BINS_PER_OCTAVE; ++bin) {
+    const double frequency = topMinFreq * std::pow(2.0, static_cast<double>(bin) / BINS_PER_OCTAVE);
+    // Q is chosen so the lowest bin of the octave exactly fills the frame
+    const unsigned length =
+        std::clamp<unsigned>(std::lround(FRAME_SIZE * topMinFreq / frequency), 2, FRAME_SIZE);
+
+    std::fill(temporal.begin(), temporal.end(), std::complex<float>{});
+    for (unsigned t = 0; t < length; ++t) {
+      const double window = 0.5 - 0.5 * std::cos(2.0 * std::numbers::pi * t / length);
+      const double phase = 2.0 * std::numbers::pi * frequency * t / topRate;
+      temporal[FRAME_SIZE - length + t] = std::polar(window / length, phase);
+    }
+    fft(temporal);
+
+    float largest = 0.0f;
+    for (const auto& value : temporal) largest = std::max(largest, std::abs(value));
+
+    kernel[bin].clear();
+    for (unsigned m = 0; m < FRAME_SIZE; ++m) {
+      if (std::abs(temporal[m]) >= KERNEL_THRESHOLD * largest) {
+        kernel[bin].push_back({m, std::conj(temporal[m]) / static_cast<float>(FRAME_SIZE)});
+      }
+    }
+  }
+}
+
+void ConstantQ::process(const float* samples, unsigned long count) {
+  std::span<const float> input(samples, count);
+  for (unsigned i = 0; i < preDecimation; ++i) {
+    preDecimators[i].process(input, preBuffers[i]);
+    input = preBuffers[i];
+  }
+
+  for (unsigned o = 0; o < octaveCount; ++o) {
+    Octave& octave = octaves[o];
+    appendToFrame(octave.frame, input);
+    if (o + 1 < octaveCount) {
+      octave.decimator.process(input, octave.decimated);
+      input = octave.decimated;
+    }
+  }
+
+  for (unsigned o = 0; o < octaveCount; ++o) {
+    const std::vector<float>& frame = octaves[o].frame;
+    std::copy(frame.begin(), frame.end(), fftBuffer.begin());
+    fft(fftBuffer);
+
+    float* magnitudes = spectrum.magnitudes.data() + (octaveCount - 1 - o) * BINS_PER_OCTAVE;
+    for (unsigned bin = 0; bin < BINS_PER_OCTAVE; ++bin) {
+      std::complex<float> sum{};
+      for (const KernelEntry& entry : kernel[bin]) {
+        sum += fftBuffer[entry.fftBin] * entry.weight;
+      }
+      magnitudes[bin] = std::abs(sum);
+    }
+  }
+}
+
+void ConstantQ::reset() {
+  for (auto& decimator : preDecimators) decimator.reset();
+  for (Octave& octave : octaves) {
+    std::fill(octave.frame.begin(), octave.frame.end(), 0.0f);
+    octave.decimator.reset();
+  }
+  std::fill(spectrum.magnitudes.begin(), spectrum.magnitudes.end(), 0.0f);
+}
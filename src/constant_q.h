@@ -0,0 +1,73 @@
+#pragma once
+#include <complex>
+#include <span>
+#include <vector>
+
+#include "freq_analysis.h"
+
+// Multi-rate constant-Q transform. A sparse spectral kernel is built once for the top octave;
+// every lower octave reuses it on a signal decimated by two more, so each octave costs a single
+// small FFT plus a few complex multiply-adds per bin. The decimators keep their state between
+// calls, so every input sample is filtered exactly once.
+//
+// The frame (and therefore Q) is the same in samples for every octave: at 48 kHz the top octave
+// frame lasts ~10 ms and the lowest ~340 ms, which is the time/frequency trade-off a constant
+// resolution in cents needs.
+class ConstantQ {
+ public:
+  static constexpr unsigned BINS_PER_SEMITONE{3};
+  static constexpr unsigned BINS_PER_OCTAVE{12 * BINS_PER_SEMITONE};
+
+  // Covers octaveCount octaves upwards from minFreq, fewer if they would reach above Nyquist
+  ConstantQ(double sampleRate, float minFreq, unsigned octaveCount);
+
+  // Feeds new samples and recomputes the magnitudes from the latest frame of every octave
+  void process(const float* samples, unsigned long count);
+
+  // Forgets all history, as if the input had been silent forever
+  void reset();
+
+  // Lowest bin first
+  const LogSpectrum& getSpectrum() const { return spectrum; }
+
+ private:
+  static constexpr unsigned FRAME_SIZE{128};  // FFT size of every octave
+  static constexpr float KERNEL_THRESHOLD{0.005f};
+
+  // Linear phase half-band lowpass followed by dropping every other sample
+  class HalfBandDecimator {
+   public:
+    HalfBandDecimator();
+    void process(std::span<const float> input, std::vector<float>& output);
+    void reset();
+
+   private:
+    static constexpr unsigned TAP_COUNT{55};
+
+    std::vector<std::pair<unsigned, float>> taps;  // Half of a half-band filter's taps are 0
+    std::vector<float> buffer;  // Previous taps.size() - 1 inputs followed by the new input
+    bool skipNext{false};       // Keeps the decimation phase across calls with odd lengths
+  };
+
+  struct KernelEntry {
+    unsigned fftBin;
+    std::complex<float> weight;
+  };
+
+  struct Octave {
+    std::vector<float> frame;      // Latest FRAME_SIZE samples at this octave's rate
+    std::vector<float> decimated;  // Input of the next octave from the current process() call
+    HalfBandDecimator decimator;
+  };
+
+  void buildKernel(double topRate, float topMinFreq);
+
+  unsigned octaveCount;
+  unsigned preDecimation;  // Stages before the top octave, keeps the top octave at ~12 kHz
+  std::vector<HalfBandDecimator> preDecimators;
+  std::vector<std::vector<float>> preBuffers;
+  std::vector<Octave> octaves;  // Highest octave first
+  std::vector<std::vector<KernelEntry>> kernel;  // One sparse row per bin of an octave
+  std::vector<std::complex<float>> fftBuffer;
+  LogSpectrum spectrum;
+};
@@ -5,6 +5,11 @@
 #include <cmath>
 #include <complex>
 #include <numbers>
+#include <numeric>
+
+float LogSpectrum::binFrequency(float bin) const {
+  return minFreq * std::pow(2.0f, bin / binsPerOctave);
+}
 
 void hannWindow(float* buffer, unsigned long bufferSize) {
   for (unsigned long i = 0; i < bufferSize; ++i) {
@@ -21,6 +26,10 @@ void fft(const float* buffer, unsigned long bufferSize, FFTData& output) {
     }
   }
 
+  fft(std::span<std::complex<float>>(output));
+}
+
+void fft(std::span<std::complex<float>> output) {
   const int n = output.size();
   for (int i = 1, j = 0; i < n; i++) {
     int bit = n >> 1;
@@ -87,6 +96,25 @@ float findPeakFrequency(const std::array<std::complex<float>, paddedSize>& fftDa
   return frequency;
 }
 
+float findPeakFrequency(const LogSpectrum& spectrum) {
+  const std::vector<float>& mag = spectrum.magnitudes;
+  if (mag.size() < 3) return 0.0f;
+
+  const size_t peakIndex =
+      std::distance(mag.begin(), std::max_element(mag.begin() + 1, mag.end() - 1));
+  if (mag[peakIndex] <= 0.0f) return 0.0f;
+
+  // Gaussian interpolation (parabola through the log magnitudes), the Hann shaped kernels make
+  // the peak close to a Gaussian on the log frequency axis
+  const float logL = std::log(mag[peakIndex - 1] + 1e-12f);
+  const float logC = std::log(mag[peakIndex]);
+  const float logR = std::log(mag[peakIndex + 1] + 1e-12f);
+  const float denominator = logL - 2 * logC + logR;
+  const float delta = denominator < 0.0f ? 0.5f * (logL - logR) / denominator : 0.0f;
+
+  return spectrum.binFrequency(peakIndex + delta);
+}
+
 float findMaxAmplitude(const float* buffer, unsigned long bufferSize) {
   float maxAmplitude = 0.0f;
   for (unsigned long i = 0; i < bufferSize; ++i) {
@@ -95,6 +123,16 @@ float findMaxAmplitude(const float* buffer, unsigned long bufferSize) {
   return maxAmplitude;
 }
 
+float findRms(const float* buffer, unsigned long bufferSize) {
+  if (bufferSize == 0) return 0.0f;
+
+  float sum = 0.0f;
+  for (unsigned long i = 0; i < bufferSize; ++i) {
+    sum += buffer[i] * buffer[i];
+  }
+  return std::sqrt(sum / bufferSize);
+}
+
 float pitchDetection(const float* buffer, unsigned long bufferSize, int sampleRate) {
   // Only perform FFT if the amplitude is above a threshold (noise gate)
   if (findMaxAmplitude(buffer, bufferSize) < 0.01f) {  // Threshold to avoid noise
@@ -131,4 +169,201 @@ NoteInfo freqToNote(float f) {
   float cents = 1200.0f * std::log2(f / noteFreq);
 
   return {std::string(NAMES[idx]), oct, cents, noteFreq, midi, f};
-}
\ No newline at end of file
+}
+
+float midiToFreq(int midi) { return 440.0f * std::pow(2.0f, (midi - 69) / 12.0f); }
+
+const std::vector<Tuning>& tunings() {
+  static const std::vector<Tuning> TUNINGS = {
+      {"standard", {40, 45, 50, 55, 59, 64}},   // E2 A2 D3 G3 B3 E4
+      {"half-down", {39, 44, 49, 54, 58, 63}},  // Eb2 Ab2 Db3 Gb3 Bb3 Eb4
+      {"drop-d", {38, 45, 50, 55, 59, 64}},     // D2 A2 D3 G3 B3 E4
+      {"dadgad", {38, 45, 50, 55, 57, 62}},     // D2 A2 D3 G3 A3 D4
+      {"open-g", {38, 43, 50, 55, 59, 62}},     // D2 G2 D3 G3 B3 D4
+      {"bass", {28, 33, 38, 43}},               // E1 A1 D2 G2
+  };
+  return TUNINGS;
+}
+
+const Tuning* findTuning(std::string_view name) {
+  for (const Tuning& tuning : tunings()) {
+    if (tuning.name == name) return &tuning;
+  }
+  return nullptr;
+}
+
+std::vector<StringResult> detectStrings(const FFTData& fftData, unsigned long blockSize,
+                                        int sampleRate, const Tuning& tuning) {
+  constexpr unsigned HARMONICS = 8;
+  constexpr float SEARCH_SEMITONES = 1.0f;
+  constexpr float MIN_RELATIVE_SALIENCE = 0.1f;  // Compared to the strongest string
+  constexpr float NOISE_FLOOR = 0.02f;           // Fundamental compared to the spectrum peak
+
+  const size_t stringCount = tuning.strings.size();
+  std::vector<StringResult> results(stringCount);
+  for (size_t s = 0; s < stringCount; ++s) {
+    results[s].target = freqToNote(midiToFreq(tuning.strings[s]));
+    results[s].detected = freqToNote(0.0f);
+  }
+  if (stringCount == 0) return results;
+
+  // Magnitudes are only needed up to the highest harmonic of the highest string
+  const float binHz = static_cast<float>(sampleRate) / fftData.size();
+  const float searchRatio = std::pow(2.0f, SEARCH_SEMITONES / 12.0f);
+  const float highestFreq = midiToFreq(*std::ranges::max_element(tuning.strings)) * searchRatio;
+  const int lobe = std::max<int>(1, 2 * fftData.size() / std::max(blockSize, 1ul));  // Hann
+  const size_t binCount =
+      std::min(fftData.size() / 2, static_cast<size_t>(highestFreq * HARMONICS / binHz) + lobe);
+
+  std::vector<float> mag(binCount);
+  for (size_t k = 0; k < binCount; ++k) {
+    mag[k] = std::abs(fftData[k]);
+  }
+  const float peakMag = *std::ranges::max_element(mag);
+  if (peakMag <= 0.0f) return results;
+
+  const std::vector<float> original = mag;  // Before any harmonic subtraction
+
+  // Largest bin within half a main lobe of `bin`, harmonics are rarely exactly at h * f0
+  auto peakIn = [&](const std::vector<float>& spectrum, float bin) -> long {
+    const long center = std::lround(bin);
+    long best = -1;
+    for (long k = std::max(1l, center - lobe / 2);
+         k <= std::min<long>(binCount - 1, center + lobe / 2); ++k) {
+      if (best < 0 || spectrum[k] > spectrum[best]) best = k;
+    }
+    return best;
+  };
+  auto harmonicPeak = [&](float bin) { return peakIn(mag, bin); };
+
+  auto salience = [&](float bin) {
+    float sum = 0.0f;
+    for (unsigned h = 1; h <= HARMONICS; ++h) {
+      const long k = harmonicPeak(bin * h);
+      if (k < 0) break;
+      sum += mag[k] / h;
+    }
+    return sum;
+  };
+
+  std::vector<bool> resolved(stringCount, false);
+  std::vector<float> fundamentalBins(stringCount, 0.0f);
+  float strongestSalience = 0.0f;
+
+  auto onUnresolvedFundamental = [&](long bin) {
+    for (size_t s = 0; s < stringCount; ++s) {
+      const float fundamental = midiToFreq(tuning.strings[s]) / binHz;
+      if (!resolved[s] && bin + lobe > fundamental / searchRatio &&
+          bin - lobe < fundamental * searchRatio) {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  for (size_t iteration = 0; iteration < stringCount; ++iteration) {
+    long bestBin = -1;
+    size_t bestString = 0;
+    float bestSalience = 0.0f;
+
+    for (size_t s = 0; s < stringCount; ++s) {
+      if (resolved[s]) continue;
+      const float target = midiToFreq(tuning.strings[s]);
+      const long lo = std::max(1l, static_cast<long>(target / searchRatio / binHz));
+      const long hi = std::min<long>(binCount - 2, std::lround(target * searchRatio / binHz));
+
+      for (long k = lo; k <= hi; ++k) {
+        if (mag[k] < mag[k - 1] || mag[k] < mag[k + 1] || mag[k] < NOISE_FLOOR * peakMag) {
+          continue;  // Fundamental must be a local peak above the noise floor
+        }
+        const float candidate = salience(static_cast<float>(k));
+        if (candidate > bestSalience) {
+          bestSalience = candidate;
+          bestBin = k;
+          bestString = s;
+        }
+      }
+    }
+
+    if (bestBin < 0 || bestSalience < MIN_RELATIVE_SALIENCE * strongestSalience) break;
+    strongestSalience = std::max(strongestSalience, bestSalience);
+
+    // Same interpolation as findPeakFrequency
+    const float magL = mag[bestBin - 1];
+    const float magC = mag[bestBin];
+    const float magR = mag[bestBin + 1];
+    const float denominator = magL - 2 * magC + magR;
+    const float delta = denominator != 0.0f ? 0.5f * (magL - magR) / denominator : 0.0f;
+    const float frequency = (bestBin + delta) * binHz;
+
+    StringResult& result = results[bestString];
+    result.detected = freqToNote(frequency);
+    result.cents = 1200.0f * std::log2(frequency / midiToFreq(tuning.strings[bestString]));
+    result.found = true;
+    resolved[bestString] = true;
+    fundamentalBins[bestString] = bestBin + delta;
+
+    // Subtract the harmonic series, but only as much of each partial as a spectrally smooth
+    // envelope (the neighbouring partials) explains, so partials shared with other strings
+    // survive. In standard tuning B3 and E4 sit almost exactly on harmonics of E2 and A2, so
+    // partials that land on the fundamental of a string not yet resolved are left alone:
+    // depending on the phases the strings can almost cancel there, and any subtraction could
+    // remove the whole fundamental. Whether such a string really sounds is checked below.
+    std::array<long, HARMONICS> peaks{};
+    std::array<float, HARMONICS> amplitudes{};
+    for (unsigned h = 0; h < HARMONICS; ++h) {
+      peaks[h] = harmonicPeak((bestBin + delta) * (h + 1));
+      amplitudes[h] = peaks[h] < 0 ? 0.0f : mag[peaks[h]];
+    }
+    for (unsigned h = 0; h < HARMONICS && peaks[h] >= 0; ++h) {
+      if (amplitudes[h] <= 0.0f || onUnresolvedFundamental(peaks[h])) continue;
+      const float prev = h > 0 ? amplitudes[h - 1] : amplitudes[h];
+      const float next = h + 1 < HARMONICS ? amplitudes[h + 1] : amplitudes[h];
+      const float smooth = (prev + next) / 2.0f;
+      const float keep = 1.0f - std::min(amplitudes[h], smooth) / amplitudes[h];
+
+      const long last = std::min<long>(binCount - 1, peaks[h] + lobe);
+      for (long k = std::max(0l, peaks[h] - lobe); k <= last; ++k) {
+        mag[k] *= keep;
+      }
+    }
+  }
+
+  // Partials explained by another found string within a main lobe and a half. Real strings have
+  // more partials than the salience uses, hence twice as many
+  auto explainedByOther = [&](size_t string, float bin) {
+    for (size_t s = 0; s < stringCount; ++s) {
+      if (s == string || !results[s].found) continue;
+      for (unsigned h = 1; h <= 2 * HARMONICS; ++h) {
+        if (std::abs(fundamentalBins[s] * h - bin) <= lobe + lobe / 2) return true;
+      }
+    }
+    return false;
+  };
+
+  // A string found on a partial of another one could just be that partial. It only counts if at
+  // least one of its own harmonics that no other found string explains stands out of the noise.
+  // Highest strings first, their false detections would otherwise explain the partials of
+  // lower strings
+  std::vector<size_t> order(stringCount);
+  std::iota(order.begin(), order.end(), 0);
+  std::ranges::sort(order, std::greater{}, [&](size_t s) { return fundamentalBins[s]; });
+  for (size_t s : order) {
+    if (!results[s].found || !explainedByOther(s, fundamentalBins[s])) continue;
+
+    bool supported = false;
+    for (unsigned h = 2; h <= HARMONICS && !supported; ++h) {
+      const float bin = fundamentalBins[s] * h;
+      if (bin >= binCount - 1 || explainedByOther(s, bin)) continue;
+      const long k = peakIn(original, bin);
+      supported = k >= 0 && original[k] >= NOISE_FLOOR * peakMag;
+    }
+    if (!supported) {
+      results[s].found = false;
+      results[s].detected = freqToNote(0.0f);
+      results[s].cents = 0.0f;
+    }
+  }
+
+  return results;
+}
@@ -3,23 +3,42 @@
 
 #include <array>
 #include <complex>
+#include <span>
 #include <string>
+#include <string_view>
+#include <vector>
 
 constexpr unsigned long paddedSize = 16384;
 using FFTData = std::array<std::complex<float>, paddedSize>;
 
+// Magnitudes on a logarithmic frequency axis, bin k is centered at minFreq * 2^(k / binsPerOctave)
+struct LogSpectrum {
+  float minFreq{1.0f};
+  unsigned binsPerOctave{12};
+  std::vector<float> magnitudes;
+
+  float binFrequency(float bin) const;
+};
+
 float signalToFreq(float* buffer, unsigned long bufferSize, int sampleRate);
 
 void hannWindow(float* buffer, unsigned long bufferSize);
 
 void fft(const float* buffer, unsigned long bufferSize, FFTData& output);
 
+// In place radix-2 FFT, the size must be a power of two
+void fft(std::span<std::complex<float>> data);
+
 float findPeakFrequency(const std::array<std::complex<float>, paddedSize>& fftData, int sampleRate);
 
+float findPeakFrequency(const LogSpectrum& spectrum);
+
 void harmonicProductSpectrum(FFTData& fftData, unsigned long factor);
 
 float findMaxAmplitude(const float* buffer, unsigned long bufferSize);
 
+float findRms(const float* buffer, unsigned long bufferSize);
+
 struct NoteInfo {
   std::string name;
   int octave;
@@ -28,4 +47,32 @@ struct NoteInfo {
   int midi;
   float inputFreq;
 };
-NoteInfo freqToNote(float frequency);
\ No newline at end of file
+NoteInfo freqToNote(float frequency);
+
+float midiToFreq(int midi);
+
+// Open string notes as MIDI numbers, lowest string first
+struct Tuning {
+  std::string name;
+  std::vector<int> strings;
+};
+
+const std::vector<Tuning>& tunings();
+
+// Returns nullptr if there is no tuning with that name
+const Tuning* findTuning(std::string_view name);
+
+struct StringResult {
+  NoteInfo target;    // Open string note from the tuning
+  NoteInfo detected;  // Only meaningful if found
+  float cents;        // Detected frequency relative to the target note
+  bool found;
+};
+
+// Resolves the fundamentals of several simultaneously sounding strings (e.g. a strum) by
+// iteratively picking the string candidate with the strongest harmonic series and subtracting
+// its harmonics from the spectrum. Each string is searched within a semitone of its target.
+// Strings found on a partial of another string must have a harmonic of their own to count.
+// Cost is bounded by strings^2 * search window * harmonics, independent of the FFT size.
+std::vector<StringResult> detectStrings(const FFTData& fftData, unsigned long blockSize,
+                                        int sampleRate, const Tuning& tuning);
\ No newline at end of file
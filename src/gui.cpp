@@ -1,6 +1,7 @@
 #include "gui.h"
 
 #include <algorithm>
+#include <thread>
 
 #include "raylib.h"
 
@@ -11,27 +12,24 @@ void GUI::initialize() {
 }
 
 void GUI::UpdateSpectrogramData() {
-  if (!newSpectrumAvailable.exchange(false, std::memory_order_acquire)) {
-    return;  // No new data available
+  {
+    std::lock_guard lock(spectrumMutex);
+    if (!newSpectrumAvailable) {
+      return;  // No new data available
+    }
+    std::swap(frontSpectrum, backSpectrum);
+    newSpectrumAvailable = false;
   }
-
-  std::vector<float> magnitudes;
-
-  const size_t fftSize = frontSpectrum.size();
-  const size_t halfSize = fftSize / 2;
-  magnitudes.resize(halfSize);
-
-  for (unsigned long i = 0; i < halfSize; ++i) {
-    float magnitude = std::abs(frontSpectrum[i]);
-    float dbMagnitude = 20.0f * log10f(magnitude + 1e-6f);
-    magnitudes[i] = dbMagnitude;
+  LogSpectrum row = frontSpectrum;
+  for (float& magnitude : row.magnitudes) {
+    magnitude = 20.0f * log10f(magnitude + 1e-6f);
   }
 
   if (spectrogramHistory.size() >= maxHistorySize) {
     spectrogramHistory.erase(spectrogramHistory.begin());
   }
 
-  spectrogramHistory.push_back(magnitudes);
+  spectrogramHistory.push_back(std::move(row));
 }
 
 void GUI::DrawGridLines() {
@@ -58,12 +56,9 @@ void GUI::DrawSpectrogram() {
     const auto& row = spectrogramHistory[t];
     float x = t * xStep;
 
-    const size_t halfSize = row.size();
-    const float fftSize = halfSize * 2.0f;
-
-    for (size_t bin = 1; bin < halfSize - 1; ++bin) {
-      float freq = bin * sampleRate / fftSize;
-      float nextFreq = (bin + 1) * sampleRate / fftSize;
+    for (size_t bin = 0; bin < row.magnitudes.size(); ++bin) {
+      float freq = row.binFrequency(bin - 0.5f);
+      float nextFreq = row.binFrequency(bin + 0.5f);
 
       if (freq < min_f || freq > max_f) continue;
 
@@ -79,9 +74,9 @@ void GUI::DrawSpectrogram() {
       float rectHeight = std::abs(yNext - y);
       if (rectHeight < 1.0f) rectHeight = 1.0f;
 
-      // Color calc
-      float db = row[bin];
-      float intensity = (db + 100.0f) / 100.0f;
+      // Color calc, a full scale sine peaks at about -12 dB
+      float db = row.magnitudes[bin];
+      float intensity = (db + 100.0f) / 90.0f;
       intensity = std::clamp(intensity, 0.0f, 1.0f);
 
       Color c = ColorFromHSV(240.0f - intensity * 240.0f, 1.0f, intensity);
@@ -93,37 +88,188 @@ void GUI::DrawSpectrogram() {
   }
 }
 
-void GUI::DrawTuner() {
-  std::string noteText = "Note: " + currentNote.name + std::to_string(currentNote.octave);
-  DrawText(noteText.c_str(), widthMargins / 2, spectrogramHeight + heightMargins / 2 + 10, 20,
-           LIGHTGRAY);
-
+void GUI::DrawTunerBar(float cents, bool showMarker, int x, int width, int centerY,
+                       int markerHeight) {
   // Draw tuning bar
-  DrawLine(widthMargins / 2, spectrogramHeight + heightMargins / 2, tunerWidth + widthMargins / 2,
-           spectrogramHeight + heightMargins / 2, GRAY);
+  DrawLine(x, centerY, x + width, centerY, GRAY);
 
-  int centerX = tunerWidth / 2;
-  int centsOffset = static_cast<int>(currentNote.cents / 100.0f * (tunerWidth / 2.0));
+  int centerX = width / 2;
+  int centsOffset = static_cast<int>(cents / 100.0f * (width / 2.0));
   int markerPosition = centerX + centsOffset;
 
-  DrawLine(widthMargins / 2 + centerX, spectrogramHeight + heightMargins / 2 - 10,
-           widthMargins / 2 + centerX, spectrogramHeight + heightMargins / 2 + 10, LIGHTGRAY);
+  DrawLine(x + centerX, centerY - markerHeight * 2 / 3, x + centerX, centerY + markerHeight * 2 / 3,
+           LIGHTGRAY);
+  if (!showMarker) {
+    return;
+  }
 
-  bool inTune = std::abs(currentNote.cents) < 5.0f;  // Within 5 cents is considered in tune
-  DrawLine(widthMargins / 2 + markerPosition, spectrogramHeight + heightMargins / 2 - 15,
-           widthMargins / 2 + markerPosition, spectrogramHeight + heightMargins / 2 + 15,
+  bool inTune = std::abs(cents) < 5.0f;  // Within 5 cents is considered in tune
+  DrawLine(x + markerPosition, centerY - markerHeight, x + markerPosition, centerY + markerHeight,
            inTune ? GREEN : RED);
 }
 
+void GUI::DrawStrings() {
+  std::vector<StringResult> strings;
+  {
+    std::lock_guard lock(tunerMutex);
+    strings = channelStrings[focusedChannel];
+  }
+  if (strings.empty()) {
+    return;  // Nothing analyzed in polyphonic mode yet
+  }
+
+  // Highest string on top, like looking down at the fretboard from the player's side
+  constexpr int labelWidth = 110;
+  const int stripHeight = tunerHeight / strings.size();
+  const int fontSize = std::clamp(stripHeight - 4, 8, 20);
+
+  for (size_t i = 0; i < strings.size(); ++i) {
+    const StringResult& string = strings[strings.size() - 1 - i];
+    const int centerY = spectrogramHeight + stripHeight * i + stripHeight / 2;
+
+    std::string text = string.target.name + std::to_string(string.target.octave);
+    text += string.found ? TextFormat("  %+.1f", string.cents) : "  --";
+    DrawText(text.c_str(), widthMargins / 2, centerY - fontSize / 2, fontSize,
+             string.found ? LIGHTGRAY : DARKGRAY);
+
+    DrawTunerBar(string.cents, string.found, widthMargins / 2 + labelWidth,
+                 tunerWidth - labelWidth, centerY, std::max(stripHeight / 2 - 1, 2));
+  }
+}
+
+void GUI::DrawTuner() {
+  if (isPolyphonic()) {
+    DrawStrings();
+    return;
+  }
+
+  std::vector<NoteInfo> notes;
+  {
+    std::lock_guard lock(tunerMutex);
+    notes = channelNotes;
+  }
+
+  if (notes.size() == 1) {
+    std::string noteText = "Note: ";
+    if (notes[0].midi != -1) {
+      noteText += notes[0].name + std::to_string(notes[0].octave);
+    }
+    DrawText(noteText.c_str(), widthMargins / 2, spectrogramHeight + heightMargins / 2 + 10, 20,
+             LIGHTGRAY);
+    DrawTunerBar(notes[0].cents, notes[0].midi != -1, widthMargins / 2, tunerWidth,
+                 spectrogramHeight + heightMargins / 2, 15);
+    return;
+  }
+
+  // One compact strip per channel: label and note on the left, tuning bar on the right
+  constexpr int labelWidth = 110;
+  const int stripHeight = tunerHeight / notes.size();
+  const int fontSize = std::clamp(stripHeight - 4, 8, 20);
+  const unsigned focused = focusedChannel.load(std::memory_order_relaxed);
+
+  for (size_t i = 0; i < notes.size(); ++i) {
+    const NoteInfo& note = notes[i];
+    const int centerY = spectrogramHeight + stripHeight * i + stripHeight / 2;
+
+    std::string text = channelLabels[i] + "  ";
+    if (note.midi != -1) {
+      text += note.name + std::to_string(note.octave);
+    }
+    DrawText(text.c_str(), widthMargins / 2, centerY - fontSize / 2, fontSize,
+             i == focused ? SKYBLUE : LIGHTGRAY);
+
+    DrawTunerBar(note.cents, note.midi != -1, widthMargins / 2 + labelWidth,
+                 tunerWidth - labelWidth, centerY, std::max(stripHeight / 2 - 1, 2));
+  }
+}
+
+void GUI::SetFocusedChannel(unsigned channel) {
+  if (channel >= channelLabels.size() || channel == focusedChannel) {
+    return;
+  }
+  focusedChannel = channel;
+  spectrogramHistory.clear();
+
+  std::lock_guard lock(spectrumMutex);
+  newSpectrumAvailable = false;  // Might belong to the previous channel
+}
+
+void GUI::DrawMetricsOverlay() {
+  const Metrics& metrics = Metrics::instance();
+  auto load = [](const std::atomic<uint64_t>& counter) {
+    return static_cast<unsigned long long>(counter.load(std::memory_order_relaxed));
+  };
+
+  constexpr int fontSize = 10;
+  constexpr int lineHeight = fontSize + 2;
+  int x = widthMargins / 2 + 5;
+  int y = 5;
+
+  DrawText(TextFormat("overflows %llu  underflows %llu  ring overruns %llu  dropped %llu  "
+                      "rec lost %llu  gated %llu",
+                      load(metrics.inputOverflows), load(metrics.inputUnderflows),
+                      load(metrics.ringOverruns), load(metrics.droppedSpectra),
+                      load(metrics.recorderBlocksLost), load(metrics.blocksGated)),
+           x, y, fontSize, YELLOW);
+
+  for (unsigned i = 0; i < static_cast<unsigned>(Stage::Count); ++i) {
+    const Stage stage = static_cast<Stage>(i);
+    const LatencyHistogram& hist = metrics.histogram(stage);
+    y += lineHeight;
+    DrawText(TextFormat("%-9s mean %7.1f us  p99 < %7.0f us  max %7.1f us",
+                        stageName(stage).data(), hist.meanMicros(), hist.percentileMicros(99.0f),
+                        hist.maxMicros()),
+             x, y, fontSize, YELLOW);
+  }
+}
+
 void GUI::mainLoop() {
+  double lastDrawTime = -IDLE_REFRESH_SECONDS;
   while (!WindowShouldClose()) {
+    bool inputEvent = IsWindowResized();
+    if (IsKeyPressed(KEY_M)) {
+      showMetrics = !showMetrics;
+      inputEvent = true;
+    }
+    if (IsKeyPressed(KEY_P)) {
+      polyphonic = !polyphonic;
+      inputEvent = true;
+    }
+    if (IsKeyPressed(KEY_TAB)) {
+      SetFocusedChannel((focusedChannel + 1) % channelLabels.size());
+      inputEvent = true;
+    }
+
+    // Only redraw for new data or input. The metrics overlay has no change notification, it is
+    // refreshed on the idle timer
+    const bool newData = redrawRequested.exchange(false);
+    if (!inputEvent && !newData && GetTime() - lastDrawTime < IDLE_REFRESH_SECONDS) {
+      // Not WaitTime(), which spins through the end of every wait in default raylib builds
+      PollInputEvents();
+      std::this_thread::sleep_for(IDLE_POLL_INTERVAL);
+      continue;
+    }
+    lastDrawTime = GetTime();
+
     BeginDrawing();
-    ClearBackground(BLACK);
-    UpdateSpectrogramData();
+    {
+      ScopedStageTimer timer{Stage::Draw};
+      ClearBackground(BLACK);
+      UpdateSpectrogramData();
+
+      DrawSpectrogram();
+      DrawGridLines();
+      DrawTuner();
+
+      if (channelLabels.size() > 1) {
+        const char* label = channelLabels[focusedChannel].c_str();
+        DrawText(label, GUI_WIDTH - widthMargins / 2 - MeasureText(label, 20), 5, 20, SKYBLUE);
+      }
+    }
 
-    DrawSpectrogram();
-    DrawGridLines();
-    DrawTuner();
+    if (showMetrics) {
+      DrawMetricsOverlay();
+    }
 
     EndDrawing();
   }
@@ -1,49 +1,97 @@
 #pragma once
 
 #include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
 #include <vector>
 
 #include "freq_analysis.h"
+#include "metrics.h"
 
 class GUI {
  public:
   static constexpr unsigned GUI_WIDTH{800};
   static constexpr unsigned GUI_HEIGHT{600};
 
-  GUI(unsigned long sampleRate) : sampleRate(sampleRate) {}
+  // One tuner strip is shown per label, channel indices passed to the setters index this list
+  explicit GUI(std::vector<std::string> channelLabels)
+      : channelLabels(std::move(channelLabels)),
+        channelNotes(this->channelLabels.size()),
+        channelStrings(this->channelLabels.size()) {}
   ~GUI() = default;
 
   void initialize();
 
   void mainLoop();
 
-  void setNewSpectrumData(FFTData&& newSpectrum) {
-    if (newSpectrumAvailable.load(std::memory_order_acquire)) {
+  // May be called concurrently for different channels, only the focused channel is drawn
+  void setNewSpectrumData(unsigned channel, const LogSpectrum& newSpectrum) {
+    if (channel != focusedChannel.load(std::memory_order_relaxed)) {
+      return;
+    }
+    std::lock_guard lock(spectrumMutex);
+    if (newSpectrumAvailable) {
+      Metrics::increment(Metrics::instance().droppedSpectra);
       return;  // Previous data not yet consumed
     }
-    backSpectrum = std::move(newSpectrum);
-    std::swap(frontSpectrum, backSpectrum);
-    newSpectrumAvailable.store(true, std::memory_order_release);
+    backSpectrum = newSpectrum;  // Reuses the allocation after the first spectrum
+    newSpectrumAvailable = true;
+    redrawRequested = true;
+  }
+
+  void setTunerData(unsigned channel, const NoteInfo& note) {
+    std::lock_guard lock(tunerMutex);
+    channelNotes[channel] = note;
+    redrawRequested = true;
   }
 
-  void setTunerData(const NoteInfo& note) { currentNote = note; }
+  void setStringData(unsigned channel, const std::vector<StringResult>& strings) {
+    std::lock_guard lock(tunerMutex);
+    channelStrings[channel] = strings;
+    redrawRequested = true;
+  }
+
+  // Polyphonic mode shows every string of the focused channel instead of one note per channel
+  void setPolyphonic(bool enabled) { polyphonic = enabled; }
+  bool isPolyphonic() const { return polyphonic.load(std::memory_order_relaxed); }
+
+  void setMetricsOverlay(bool enabled) { showMetrics = enabled; }
 
  private:
   void UpdateSpectrogramData();
   void DrawSpectrogram();
   void DrawGridLines();
   void DrawTuner();
+  void DrawStrings();
+  void DrawTunerBar(float cents, bool showMarker, int x, int width, int centerY,
+                    int markerHeight);
+  void SetFocusedChannel(unsigned channel);
+  void DrawMetricsOverlay();
+
+  // Double buffered spectrum data to avoid locking during drawing. Producers fill the back
+  // buffer under the mutex, the GUI swaps it to the front and draws from there
+  LogSpectrum backSpectrum;
+  LogSpectrum frontSpectrum;
+  bool newSpectrumAvailable{false};
+  std::mutex spectrumMutex;
 
-  // Double buffered spectrum data to avoid locking during drawing
-  FFTData backSpectrum{};
-  FFTData frontSpectrum{};
-  std::atomic<bool> newSpectrumAvailable{false};
+  std::vector<std::string> channelLabels;
+  std::vector<NoteInfo> channelNotes;
+  std::vector<std::vector<StringResult>> channelStrings;
+  std::mutex tunerMutex;
+  std::atomic<unsigned> focusedChannel{0};  // Channel shown in the spectrogram, cycled with TAB
+  std::atomic<bool> polyphonic{false};      // Toggled with the P key
+  bool showMetrics{false};                  // Toggled with the M key
 
-  unsigned long sampleRate;
-  NoteInfo currentNote{};
+  // The window is only redrawn when a setter delivered new data, on input, or every
+  // IDLE_REFRESH_SECONDS. In between, input is polled every IDLE_POLL_INTERVAL
+  std::atomic<bool> redrawRequested{true};
+  static constexpr double IDLE_REFRESH_SECONDS = 1.0;
+  static constexpr std::chrono::milliseconds IDLE_POLL_INTERVAL{20};
 
-  // Scrolling spectrogram visualization data
-  std::vector<std::vector<float>> spectrogramHistory;
+  // Scrolling spectrogram visualization data, magnitudes in dB
+  std::vector<LogSpectrum> spectrogramHistory;
   static constexpr size_t maxHistorySize = 150;
   static inline constexpr float min_f = 70.0f;
   static inline constexpr float max_f = 4000.0f;
@@ -1,12 +1,19 @@
 #include <raylib.h>
 
 #include <csignal>
+#include <cstdlib>
 #include <iomanip>
 #include <iostream>
+#include <memory>
+#include <string_view>
+#include <vector>
 
+#include "analyzer.h"
 #include "audio_engine.h"
 #include "freq_analysis.h"
 #include "gui.h"
+#include "metrics.h"
+#include "recorder.h"
 
 using std::cout;
 
@@ -36,33 +43,155 @@ void printTuner(const NoteInfo& info, float freq) {
   std::cout << std::flush;
 }
 
+struct Options {
+  std::string deviceName{"Scarlett"};
+  int metricsInterval{0};  // Seconds between metric dumps to stdout, 0 disables
+  bool metricsOverlay{false};
+  std::string recordPath;  // Stream the captured samples to this file
+  std::string replayPath;  // Analyze this recording instead of a live device
+  bool replayFast{false};  // Replay as fast as the analysis keeps up instead of in real time
+  std::vector<int> inputChannels;  // Zero based, empty keeps the engine default
+  bool polyphonic{false};          // Start in polyphonic (strum) mode
+  std::string tuning{"standard"};
+  AudioConfig audio{};
+};
+
+// Parses a comma separated list of one based input numbers, as printed on the interface
+std::vector<int> parseChannelList(std::string_view list) {
+  std::vector<int> channels;
+  while (!list.empty()) {
+    const size_t comma = list.find(',');
+    channels.push_back(std::atoi(std::string(list.substr(0, comma)).c_str()) - 1);
+    list = comma == std::string_view::npos ? std::string_view{} : list.substr(comma + 1);
+  }
+  return channels;
+}
+
+Options parseOptions(int argc, char* argv[]) {
+  Options options{};
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg{argv[i]};
+    if (arg == "--metrics") {
+      options.metricsInterval = 10;
+    } else if (arg.starts_with("--metrics=")) {
+      options.metricsInterval = std::atoi(arg.substr(arg.find('=') + 1).data());
+    } else if (arg == "--metrics-overlay") {
+      options.metricsOverlay = true;
+    } else if (arg == "--record" && i + 1 < argc) {
+      options.recordPath = argv[++i];
+    } else if (arg == "--replay" && i + 1 < argc) {
+      options.replayPath = argv[++i];
+    } else if (arg == "--replay-fast") {
+      options.replayFast = true;
+    } else if (arg == "--channels" && i + 1 < argc) {
+      options.inputChannels = parseChannelList(argv[++i]);
+    } else if (arg == "--poly") {
+      options.polyphonic = true;
+    } else if (arg == "--tuning" && i + 1 < argc) {
+      options.tuning = argv[++i];
+    } else if (arg == "--rate" && i + 1 < argc) {
+      options.audio.sampleRate = std::atof(argv[++i]);
+    } else if (arg == "--buffer" && i + 1 < argc) {
+      options.audio.framesPerBuffer = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--window" && i + 1 < argc) {
+      options.audio.analysisWindow = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--ring" && i + 1 < argc) {
+      options.audio.ringCapacity = std::strtoul(argv[++i], nullptr, 10);
+    } else {
+      options.deviceName = arg;
+    }
+  }
+  return options;
+}
+
 int main(int argc, char* argv[]) {
   signal(SIGINT, signalHandler);
   signal(SIGTERM, signalHandler);
 
+  const Options options = parseOptions(argc, argv);
+  if (!options.recordPath.empty() && !options.replayPath.empty()) {
+    std::cout << "--record cannot be combined with --replay\n";
+    return -1;
+  }
+
+  const Tuning* tuning = findTuning(options.tuning);
+  if (!tuning) {
+    std::cout << "Unknown tuning " << options.tuning << ", available:";
+    for (const Tuning& available : tunings()) {
+      std::cout << " " << available.name;
+    }
+    std::cout << "\n";
+    return -1;
+  }
+
+  // Declared before the engine so it outlives the stream, which writes to it until stopped
+  Recorder recorder{};
   AudioEngine engine{};
-  std::string deviceName = argc > 1 ? argv[1] : "Scarlett";
-  if (!engine.init(deviceName)) {
+  if (!options.replayPath.empty()) {
+    const ReplayPace pace =
+        options.replayFast ? ReplayPace::AsFastAsPossible : ReplayPace::Realtime;
+    if (!engine.initReplay(options.replayPath, pace)) {
+      std::cout << "Could not initialize replay\n";
+      return -1;
+    }
+  } else if (!engine.init(options.deviceName)) {
     std::cout << "Could not initialize audio engine\n";
     return -1;
   }
 
+  if (!options.inputChannels.empty() && !engine.setInputChannels(options.inputChannels)) {
+    return -1;
+  }
+  if (!engine.setConfig(options.audio)) {
+    return -1;
+  }
+
   // Get sample rate
-  const auto sampleRate = engine.getDeviceInfo()->defaultSampleRate;
-  GUI gui{static_cast<unsigned long>(sampleRate)};
-  gui.initialize();
+  const auto sampleRate = engine.getSampleRate();
+
+  if (!options.recordPath.empty()) {
+    if (!recorder.open(options.recordPath, sampleRate, engine.getChannelCount(),
+                       engine.getConfig().analysisWindow)) {
+      return -1;
+    }
+    engine.setRecorder(&recorder);
+  }
 
-  auto callback = [&](std::array<SAMPLE, SAMPLES_PER_CALLBACK> buffer, unsigned long bufferSize,
-                      [[maybe_unused]] int sampleRate) {
-    hannWindow(buffer.data(), bufferSize);
-    FFTData fftOutput{};
-    fft(buffer.data(), bufferSize, fftOutput);
+  std::vector<std::string> channelLabels;
+  std::vector<std::unique_ptr<ChannelAnalyzer>> analyzers;
+  for (int channel : engine.getInputChannels()) {
+    channelLabels.push_back("In " + std::to_string(channel + 1));
+    analyzers.push_back(std::make_unique<ChannelAnalyzer>(static_cast<int>(sampleRate), *tuning));
+  }
 
-    float frequency = findPeakFrequency(fftOutput, sampleRate);
-    NoteInfo note = freqToNote(frequency);
+  GUI gui{channelLabels};
+  gui.initialize();
+  gui.setMetricsOverlay(options.metricsOverlay);
+  gui.setPolyphonic(options.polyphonic);
+
+  std::unique_ptr<MetricsReporter> reporter;
+  if (options.metricsInterval > 0) {
+    reporter = std::make_unique<MetricsReporter>(std::chrono::seconds(options.metricsInterval),
+                                                 std::cout);
+  }
 
-    gui.setNewSpectrumData(std::move(fftOutput));
-    gui.setTunerData(note);
+  auto callback = [&](unsigned channel, AudioBlock& buffer, unsigned long bufferSize,
+                      [[maybe_unused]] int sampleRate) {
+    ChannelAnalyzer& analyzer = *analyzers[channel];
+    analyzer.setPolyphonic(gui.isPolyphonic());
+    if (!analyzer.process(buffer, bufferSize)) {
+      return;  // Still silent, the GUI already shows the silent result
+    }
+
+    {
+      ScopedStageTimer timer{Stage::Publish};
+      gui.setNewSpectrumData(channel, analyzer.getSpectrum());
+      gui.setTunerData(channel, analyzer.getNote());
+      gui.setStringData(channel, analyzer.getStrings());
+    }
+    if (!analyzer.isSilent()) {
+      Metrics::increment(Metrics::instance().blocksAnalyzed);
+    }
   };
 
   if (!engine.openStream()) {
@@ -83,4 +212,9 @@ int main(int argc, char* argv[]) {
     std::cout << "Could not stop audio stream\n";
     return -1;
   }
+  recorder.close();
+
+  if (reporter) {
+    Metrics::instance().dump(std::cout);
+  }
 }
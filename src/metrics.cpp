@@ -0,0 +1,81 @@
+#include "metrics.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <condition_variable>
+#include <iomanip>
+#include <mutex>
+
+void LatencyHistogram::record(std::chrono::nanoseconds duration) {
+  const uint64_t nanos = static_cast<uint64_t>(std::max<int64_t>(duration.count(), 0));
+  const unsigned bucket = std::min<unsigned>(std::bit_width(nanos / 1000), BUCKET_COUNT - 1);
+
+  buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+  total.fetch_add(1, std::memory_order_relaxed);
+  sumNanos.fetch_add(nanos, std::memory_order_relaxed);
+
+  uint64_t previousMax = maxNanos.load(std::memory_order_relaxed);
+  while (nanos > previousMax &&
+         !maxNanos.compare_exchange_weak(previousMax, nanos, std::memory_order_relaxed)) {
+  }
+}
+
+float LatencyHistogram::meanMicros() const {
+  const uint64_t n = count();
+  return n == 0 ? 0.0f : sumNanos.load(std::memory_order_relaxed) / 1000.0f / n;
+}
+
+float LatencyHistogram::percentileMicros(float percentile) const {
+  const uint64_t n = count();
+  if (n == 0) return 0.0f;
+
+  const uint64_t target = static_cast<uint64_t>(std::ceil(n * percentile / 100.0f));
+  uint64_t seen = 0;
+  for (unsigned i = 0; i < BUCKET_COUNT; ++i) {
+    seen += buckets[i].load(std::memory_order_relaxed);
+    if (seen >= target) {
+      return static_cast<float>(1ull << i);
+    }
+  }
+  return maxMicros();
+}
+
+Metrics& Metrics::instance() {
+  static Metrics metrics;
+  return metrics;
+}
+
+void Metrics::dump(std::ostream& out) const {
+  auto load = [](const std::atomic<uint64_t>& counter) {
+    return counter.load(std::memory_order_relaxed);
+  };
+
+  out << "[metrics] blocks=" << load(blocksAnalyzed) << " gated=" << load(blocksGated)
+      << " overflows=" << load(inputOverflows) << " underflows=" << load(inputUnderflows)
+      << " ringOverruns=" << load(ringOverruns) << " droppedSpectra=" << load(droppedSpectra)
+      << " recorderBlocksLost=" << load(recorderBlocksLost) << "\n";
+
+  for (unsigned i = 0; i < static_cast<unsigned>(Stage::Count); ++i) {
+    const auto& hist = stages[i];
+    out << "[metrics]   " << std::left << std::setw(9) << stageName(static_cast<Stage>(i))
+        << std::right << std::fixed << std::setprecision(1) << " n=" << hist.count()
+        << " mean=" << hist.meanMicros() << "us p50<" << hist.percentileMicros(50.0f)
+        << "us p99<" << hist.percentileMicros(99.0f) << "us max=" << hist.maxMicros() << "us\n";
+  }
+  out << std::flush;
+}
+
+MetricsReporter::MetricsReporter(std::chrono::seconds interval, std::ostream& out)
+    : reportThread([interval, &out](std::stop_token stopToken) {
+        std::mutex mutex;
+        std::condition_variable_any wakeUp;
+        std::unique_lock lock(mutex);
+        while (true) {
+          wakeUp.wait_for(lock, stopToken, interval, [] { return false; });
+          if (stopToken.stop_requested()) {
+            return;
+          }
+          Metrics::instance().dump(out);
+        }
+      }) {}
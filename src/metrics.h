@@ -0,0 +1,96 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+#include <thread>
+
+// Pipeline stages that are timed. Capture runs on the PortAudio thread, the analysis stages on
+// the audio processing thread and Draw on the GUI thread.
+enum class Stage : unsigned { Capture, Gate, Window, Transform, PeakSearch, Publish, Draw, Count };
+
+constexpr std::string_view stageName(Stage stage) {
+  constexpr std::array<std::string_view, static_cast<unsigned>(Stage::Count)> NAMES = {
+      "capture", "gate", "window", "transform", "peak", "publish", "draw"};
+  return NAMES[static_cast<unsigned>(stage)];
+}
+
+// Lock-free latency histogram with power-of-two microsecond buckets. Recording is a handful of
+// relaxed atomic operations, so it is safe to use from the realtime audio callback.
+class LatencyHistogram {
+ public:
+  static constexpr unsigned BUCKET_COUNT{24};  // Bucket i holds durations below 2^i us (~8 s)
+
+  void record(std::chrono::nanoseconds duration);
+
+  uint64_t count() const { return total.load(std::memory_order_relaxed); }
+  float meanMicros() const;
+  float maxMicros() const { return maxNanos.load(std::memory_order_relaxed) / 1000.0f; }
+
+  // Upper bound of the bucket containing the given percentile (0-100)
+  float percentileMicros(float percentile) const;
+
+ private:
+  std::array<std::atomic<uint64_t>, BUCKET_COUNT> buckets{};
+  std::atomic<uint64_t> total{0};
+  std::atomic<uint64_t> sumNanos{0};
+  std::atomic<uint64_t> maxNanos{0};
+};
+
+struct Metrics {
+  static Metrics& instance();
+
+  void record(Stage stage, std::chrono::nanoseconds duration) {
+    stages[static_cast<unsigned>(stage)].record(duration);
+  }
+
+  const LatencyHistogram& histogram(Stage stage) const {
+    return stages[static_cast<unsigned>(stage)];
+  }
+
+  static void increment(std::atomic<uint64_t>& counter, uint64_t amount = 1) {
+    counter.fetch_add(amount, std::memory_order_relaxed);
+  }
+
+  // Writes a human readable summary of all counters and stage latencies
+  void dump(std::ostream& out) const;
+
+  std::atomic<uint64_t> inputOverflows{0};      // paInputOverflow reported by the callback
+  std::atomic<uint64_t> inputUnderflows{0};     // paInputUnderflow reported by the callback
+  std::atomic<uint64_t> ringOverruns{0};        // Samples that did not fit in the ring buffer
+  std::atomic<uint64_t> droppedSpectra{0};      // Spectra discarded because the GUI was behind
+  std::atomic<uint64_t> recorderBlocksLost{0};  // Blocks the recorder could not queue or write
+  std::atomic<uint64_t> blocksAnalyzed{0};
+  std::atomic<uint64_t> blocksGated{0};  // Blocks skipped because the input was silent
+
+ private:
+  std::array<LatencyHistogram, static_cast<unsigned>(Stage::Count)> stages{};
+};
+
+// Records the lifetime of the timer into the given stage
+class ScopedStageTimer {
+ public:
+  explicit ScopedStageTimer(Stage stage)
+      : stage(stage), start(std::chrono::steady_clock::now()) {}
+  ~ScopedStageTimer() {
+    Metrics::instance().record(stage, std::chrono::steady_clock::now() - start);
+  }
+
+  ScopedStageTimer(const ScopedStageTimer&) = delete;
+  ScopedStageTimer& operator=(const ScopedStageTimer&) = delete;
+
+ private:
+  Stage stage;
+  std::chrono::steady_clock::time_point start;
+};
+
+// Periodically dumps the metrics from a background thread until destroyed
+class MetricsReporter {
+ public:
+  MetricsReporter(std::chrono::seconds interval, std::ostream& out);
+
+ private:
+  std::jthread reportThread;
+};
@@ -0,0 +1,28 @@
+#include "noise_gate.h"
+
+#include <algorithm>
+
+#include "freq_analysis.h"
+
+NoiseGate::NoiseGate(int sampleRate, float openThreshold, float closeThreshold,
+                     float holdSeconds)
+    : openThreshold(openThreshold),
+      closeThreshold(std::min(closeThreshold, openThreshold)),
+      holdSamples(static_cast<unsigned long>(std::max(0.0f, holdSeconds) * sampleRate)) {}
+
+bool NoiseGate::process(const float* samples, unsigned long count) {
+  level = findRms(samples, count);
+
+  if (level >= openThreshold) {
+    open = true;
+    quietSamples = 0;
+  } else if (open) {
+    if (level < closeThreshold) {
+      quietSamples += count;
+      open = quietSamples < holdSamples;
+    } else {
+      quietSamples = 0;  // Between the thresholds, keep holding
+    }
+  }
+  return open;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+// RMS noise gate with hysteresis and a hold time. The gate opens as soon as a block reaches the
+// open threshold and only closes after the level stayed below the lower close threshold for the
+// whole hold time, so decaying notes and short pauses between plucks are not chopped up.
+class NoiseGate {
+ public:
+  static constexpr float DEFAULT_OPEN_THRESHOLD{0.007f};  // RMS of a sine peaking at 0.01
+  static constexpr float DEFAULT_CLOSE_THRESHOLD{0.0035f};
+  static constexpr float DEFAULT_HOLD_SECONDS{0.3f};
+
+  explicit NoiseGate(int sampleRate, float openThreshold = DEFAULT_OPEN_THRESHOLD,
+                     float closeThreshold = DEFAULT_CLOSE_THRESHOLD,
+                     float holdSeconds = DEFAULT_HOLD_SECONDS);
+
+  // Updates the gate with the next block of samples, returns whether the gate is open
+  bool process(const float* samples, unsigned long count);
+
+  bool isOpen() const { return open; }
+
+  // RMS of the last processed block
+  float getLevel() const { return level; }
+
+ private:
+  float openThreshold;
+  float closeThreshold;
+  unsigned long holdSamples;
+  unsigned long quietSamples{0};  // Samples below the close threshold since the last loud block
+  float level{0.0f};
+  bool open{false};
+};
@@ -0,0 +1,244 @@
+#include "recorder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+#include "metrics.h"
+
+bool Recorder::open(const std::string& path, double sampleRate, unsigned channelCount,
+                    unsigned long analysisWindow) {
+  close();
+
+  file.open(path, std::ios::binary | std::ios::trunc);
+  if (!file) {
+    std::cout << "Could not open recording file " << path << std::endl;
+    return false;
+  }
+
+  std::memcpy(header.magic, RECORDING_MAGIC, sizeof(header.magic));
+  header.version = RECORDING_VERSION;
+  header.channelCount = channelCount;
+  header.blockFrames = RECORDING_BLOCK_FRAMES;
+  header.sampleRate = sampleRate;
+  header.analysisWindow = static_cast<uint32_t>(analysisWindow);
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+  blockStride = recordingBlockStride(header);
+  stagingSamples.assign(header.blockFrames * header.channelCount, 0.0f);
+  stagingDrops.assign(header.channelCount * RECORDING_MAX_DROPS, RecordingDrop{});
+  staging = {};
+  framesWritten = 0;
+  blocksLost = false;
+  writeFailed = false;
+
+  queueData.assign(blockStride * BLOCK_QUEUE_SIZE, 0);
+  if (PaUtil_InitializeRingBuffer(&queue, blockStride, BLOCK_QUEUE_SIZE, queueData.data()) < 0) {
+    std::cout << "Could not initialize recorder queue" << std::endl;
+    file.close();
+    return false;
+  }
+
+  writerThread = std::jthread([this](std::stop_token stopToken) {
+    while (!stopToken.stop_requested()) {
+      drainQueue();
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    drainQueue();
+  });
+
+  return true;
+}
+
+void Recorder::write(const float* samples, unsigned long frames, double adcTime, uint32_t flags,
+                     const unsigned long* ringDropped) {
+  const unsigned channels = header.channelCount;
+  unsigned long offset = 0;
+
+  while (offset < frames) {
+    if (staging.frameCount == 0) {
+      staging.firstFrame = framesWritten;
+      staging.adcTime = adcTime + offset / header.sampleRate;
+    }
+    if (offset == 0) {
+      staging.flags |= flags;
+    }
+
+    const unsigned long count =
+        std::min<unsigned long>(frames - offset, header.blockFrames - staging.frameCount);
+
+    // The dropped frames are always the tail of the call, so a drop ends with this chunk
+    for (unsigned c = 0; ringDropped && c < channels; ++c) {
+      const unsigned long firstDropped = frames - std::min(ringDropped[c], frames);
+      const unsigned long dropStart = std::max(offset, firstDropped);
+      if (dropStart < offset + count) {
+        addDrop(c, staging.frameCount + (dropStart - offset), offset + count - dropStart);
+      }
+    }
+
+    std::copy_n(samples + offset * channels, count * channels,
+                stagingSamples.begin() + staging.frameCount * channels);
+
+    staging.frameCount += count;
+    framesWritten += count;
+    offset += count;
+
+    if (staging.frameCount == header.blockFrames) {
+      pushStagingBlock();
+    }
+  }
+}
+
+void Recorder::addDrop(unsigned channel, uint32_t offset, uint32_t count) {
+  staging.flags |= RECORDING_FLAG_RING_OVERRUN;
+  RecordingDrop* drops = stagingDrops.data() + channel * RECORDING_MAX_DROPS;
+  unsigned used = 0;
+  while (used < RECORDING_MAX_DROPS && drops[used].count > 0) {
+    ++used;
+  }
+
+  // Consecutive callbacks that all overran continue the previous drop
+  if (used > 0 && (drops[used - 1].offset + drops[used - 1].count == offset ||
+                   used == RECORDING_MAX_DROPS)) {
+    drops[used - 1].count = offset + count - drops[used - 1].offset;
+  } else {
+    drops[used] = {offset, count};
+  }
+}
+
+void Recorder::pushStagingBlock() {
+  if (PaUtil_GetRingBufferWriteAvailable(&queue) == 0) {
+    // Writer thread is behind, drop the block and mark the gap on the next one
+    blocksLost = true;
+    Metrics::increment(Metrics::instance().recorderBlocksLost);
+  } else {
+    void* region1;
+    void* region2;
+    ring_buffer_size_t size1;
+    ring_buffer_size_t size2;
+    PaUtil_GetRingBufferWriteRegions(&queue, 1, &region1, &size1, &region2, &size2);
+
+    if (blocksLost) {
+      staging.flags |= RECORDING_FLAG_BLOCKS_LOST;
+      blocksLost = false;
+    }
+
+    char* slot = static_cast<char*>(region1);
+    const size_t dropsBytes = recordingDropsSize(header);
+    const size_t validBytes = staging.frameCount * header.channelCount * sizeof(float);
+    std::memcpy(slot, &staging, sizeof(staging));
+    slot += sizeof(staging);
+    std::memcpy(slot, stagingDrops.data(), dropsBytes);
+    slot += dropsBytes;
+    std::memcpy(slot, stagingSamples.data(), validBytes);
+    std::memset(slot + validBytes, 0, blockStride - sizeof(staging) - dropsBytes - validBytes);
+    PaUtil_AdvanceRingBufferWriteIndex(&queue, 1);
+  }
+
+  staging = {};
+  std::ranges::fill(stagingDrops, RecordingDrop{});
+}
+
+void Recorder::drainQueue() {
+  void* region1;
+  void* region2;
+  ring_buffer_size_t size1;
+  ring_buffer_size_t size2;
+  const ring_buffer_size_t available = PaUtil_GetRingBufferReadRegions(
+      &queue, PaUtil_GetRingBufferReadAvailable(&queue), &region1, &size1, &region2, &size2);
+  if (available == 0) {
+    return;
+  }
+
+  // Once a write failed (e.g. the disk is full) the stream stays failed, every later block is lost
+  if (!writeFailed) {
+    file.write(static_cast<const char*>(region1), size1 * blockStride);
+    if (size2 > 0) {
+      file.write(static_cast<const char*>(region2), size2 * blockStride);
+    }
+    file.flush();
+    if (!file) {
+      std::cout << "Could not write recording, the rest of the session is lost" << std::endl;
+      writeFailed = true;
+    }
+  }
+  if (writeFailed) {
+    Metrics::increment(Metrics::instance().recorderBlocksLost, available);
+  }
+  PaUtil_AdvanceRingBufferReadIndex(&queue, available);
+}
+
+void Recorder::close() {
+  if (!file.is_open()) {
+    return;
+  }
+
+  if (staging.frameCount > 0) {
+    pushStagingBlock();
+  }
+  if (writerThread.joinable()) {
+    writerThread.request_stop();
+    writerThread.join();
+  }
+  file.close();
+}
+
+bool RecordingReader::open(const std::string& path) {
+  file.open(path, std::ios::binary);
+  if (!file) {
+    std::cout << "Could not open recording " << path << std::endl;
+    return false;
+  }
+
+  file.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (!file || std::memcmp(header.magic, RECORDING_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != RECORDING_VERSION || header.channelCount == 0 ||
+      header.blockFrames == 0 || !std::isfinite(header.sampleRate) || header.sampleRate <= 0.0 ||
+      header.analysisWindow == 0) {
+    std::cout << "Not a valid recording: " << path << std::endl;
+    return false;
+  }
+
+  const auto fileSize = std::filesystem::file_size(path);
+  blocks = (fileSize - sizeof(header)) / recordingBlockStride(header);
+  return true;
+}
+
+bool RecordingReader::readBlock(size_t index, RecordingBlockHeader& blockHeader,
+                                std::vector<float>& samples, std::vector<RecordingDrop>* drops) {
+  if (index >= blocks) {
+    return false;
+  }
+
+  file.seekg(sizeof(header) + index * recordingBlockStride(header));
+  file.read(reinterpret_cast<char*>(&blockHeader), sizeof(blockHeader));
+  if (!file || blockHeader.frameCount > header.blockFrames) {
+    return false;
+  }
+
+  if (drops) {
+    drops->resize(header.channelCount * RECORDING_MAX_DROPS);
+    file.read(reinterpret_cast<char*>(drops->data()), recordingDropsSize(header));
+    // Every channel's drops must be in order and within the valid frames
+    for (size_t c = 0; c < header.channelCount; ++c) {
+      uint64_t end = 0;
+      for (size_t i = c * RECORDING_MAX_DROPS; i < (c + 1) * RECORDING_MAX_DROPS; ++i) {
+        const RecordingDrop& drop = (*drops)[i];
+        if (drop.count == 0) break;
+        if (drop.offset < end || uint64_t{drop.offset} + drop.count > blockHeader.frameCount) {
+          return false;
+        }
+        end = uint64_t{drop.offset} + drop.count;
+      }
+    }
+  } else {
+    file.seekg(recordingDropsSize(header), std::ios::cur);
+  }
+
+  samples.resize(blockHeader.frameCount * header.channelCount);
+  file.read(reinterpret_cast<char*>(samples.data()), samples.size() * sizeof(float));
+  return static_cast<bool>(file);
+}
@@ -0,0 +1,138 @@
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "pa_ringbuffer.h"
+#include "portaudio.h"
+
+// On-disk layout of a capture recording (native endianness, no compression):
+//
+//   RecordingHeader
+//   block 0: RecordingBlockHeader
+//            channelCount * RECORDING_MAX_DROPS RecordingDrop entries, grouped by channel
+//            blockFrames * channelCount interleaved float samples
+//   block 1: ...
+//
+// Every block occupies exactly the same number of bytes (the last one is zero padded), so block
+// i lives at sizeof(RecordingHeader) + i * blockStride() and the file can be mmapped or seeked
+// directly. The block count is derived from the file size, so a crashed session stays readable.
+
+constexpr char RECORDING_MAGIC[4] = {'G', 'T', 'R', 'C'};
+constexpr uint32_t RECORDING_VERSION{4};
+constexpr uint32_t RECORDING_BLOCK_FRAMES{1024};
+constexpr uint32_t RECORDING_MAX_DROPS{8};  // Ring overruns kept per channel and block
+
+// Block flags marking discontinuities in the captured signal
+constexpr uint32_t RECORDING_FLAG_INPUT_OVERFLOW{1u << 0};
+constexpr uint32_t RECORDING_FLAG_INPUT_UNDERFLOW{1u << 1};
+constexpr uint32_t RECORDING_FLAG_RING_OVERRUN{1u << 2};  // Analysis ring dropped samples
+constexpr uint32_t RECORDING_FLAG_BLOCKS_LOST{1u << 3};   // Recorder dropped preceding blocks
+
+struct RecordingHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t channelCount;
+  uint32_t blockFrames;
+  double sampleRate;
+  uint32_t analysisWindow;  // Samples per analysis block of the recorded session
+  uint32_t reserved;
+};
+static_assert(sizeof(RecordingHeader) == 32);
+
+struct RecordingBlockHeader {
+  uint64_t firstFrame;  // Index of the first frame since the recording started
+  double adcTime;       // PortAudio input ADC time of the first frame, in seconds
+  uint32_t flags;
+  uint32_t frameCount;  // Valid frames in this block, below blockFrames only for the last one
+};
+static_assert(sizeof(RecordingBlockHeader) == 24);
+
+// Frames [offset, offset + count) of a block that never reached the analysis ring of one
+// channel (RECORDING_FLAG_RING_OVERRUN). Each channel's ring drains on its own, so every channel
+// has its own list, in frame order and terminated by the first entry with a count of 0. A new
+// overrun can only start once the analysis read a window, so more than RECORDING_MAX_DROPS per
+// block are rare; any beyond that are merged into the last entry. A fast replay drops the same
+// frames, a real time replay has overruns of its own
+struct RecordingDrop {
+  uint32_t offset;
+  uint32_t count;
+};
+static_assert(sizeof(RecordingDrop) == 8);
+
+inline size_t recordingDropsSize(const RecordingHeader& header) {
+  return header.channelCount * RECORDING_MAX_DROPS * sizeof(RecordingDrop);
+}
+
+inline size_t recordingBlockStride(const RecordingHeader& header) {
+  return sizeof(RecordingBlockHeader) + recordingDropsSize(header) +
+         header.blockFrames * header.channelCount * sizeof(float);
+}
+
+// Streams captured samples to disk. write() is called from the PortAudio callback and only
+// copies into preallocated memory; a background thread does the file I/O.
+class Recorder {
+ public:
+  ~Recorder() { close(); }
+
+  bool open(const std::string& path, double sampleRate, unsigned channelCount,
+            unsigned long analysisWindow);
+
+  // Realtime safe. Samples are interleaved with the channel count given to open(). If given,
+  // `ringDropped` holds per channel how many of the last frames its analysis ring had no room for
+  void write(const float* samples, unsigned long frames, double adcTime, uint32_t flags,
+             const unsigned long* ringDropped = nullptr);
+
+  // Flushes the pending partial block and stops the writer. Call after the stream is stopped
+  void close();
+
+  bool isOpen() const { return file.is_open(); }
+
+  double getSampleRate() const { return header.sampleRate; }
+
+ private:
+  static constexpr unsigned BLOCK_QUEUE_SIZE{64};  // Must be a power of two
+
+  void addDrop(unsigned channel, uint32_t offset, uint32_t count);
+  void pushStagingBlock();
+  void drainQueue();
+
+  std::ofstream file;
+  RecordingHeader header{};
+  size_t blockStride{0};
+
+  // Block currently being filled by the audio callback
+  RecordingBlockHeader staging{};
+  std::vector<RecordingDrop> stagingDrops;
+  std::vector<float> stagingSamples;
+  uint64_t framesWritten{0};
+  bool blocksLost{false};
+  bool writeFailed{false};  // Only touched by the writer thread
+
+  // Completed blocks waiting for the writer thread
+  std::vector<char> queueData;
+  PaUtilRingBuffer queue{};
+  std::jthread writerThread;
+};
+
+// Random access reader for recordings produced by Recorder
+class RecordingReader {
+ public:
+  bool open(const std::string& path);
+
+  const RecordingHeader& getHeader() const { return header; }
+
+  size_t blockCount() const { return blocks; }
+
+  // Reads block `index`, resizing `samples` to frameCount * channelCount. `drops` receives
+  // channelCount * RECORDING_MAX_DROPS entries if given
+  bool readBlock(size_t index, RecordingBlockHeader& blockHeader, std::vector<float>& samples,
+                 std::vector<RecordingDrop>* drops = nullptr);
+
+ private:
+  std::ifstream file;
+  RecordingHeader header{};
+  size_t blocks{0};
+};
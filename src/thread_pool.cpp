@@ -0,0 +1,42 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned threadCount) {
+  threadCount = std::max(1u, threadCount);
+  workers.reserve(threadCount);
+  for (unsigned i = 0; i < threadCount; ++i) {
+    workers.emplace_back([this](std::stop_token stopToken) { workerLoop(stopToken); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  for (auto& worker : workers) {
+    worker.request_stop();
+  }
+  workers.clear();  // Joins
+}
+
+void ThreadPool::submit(std::function<void()> job) {
+  {
+    std::lock_guard lock(mutex);
+    jobs.push_back(std::move(job));
+  }
+  jobAvailable.notify_one();
+}
+
+void ThreadPool::workerLoop(std::stop_token stopToken) {
+  while (true) {
+    std::function<void()> job;
+    {
+      std::unique_lock lock(mutex);
+      jobAvailable.wait(lock, stopToken, [this] { return !jobs.empty(); });
+      if (jobs.empty()) {
+        return;  // Stop requested and nothing left to run
+      }
+      job = std::move(jobs.front());
+      jobs.pop_front();
+    }
+    job();
+  }
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed size pool of worker threads consuming a shared FIFO job queue
+class ThreadPool {
+ public:
+  explicit ThreadPool(unsigned threadCount);
+
+  // Runs the jobs that are still queued before joining the workers
+  ~ThreadPool();
+
+  void submit(std::function<void()> job);
+
+  unsigned size() const { return static_cast<unsigned>(workers.size()); }
+
+ private:
+  void workerLoop(std::stop_token stopToken);
+
+  std::mutex mutex;
+  std::condition_variable_any jobAvailable;
+  std::deque<std::function<void()>> jobs;
+  std::vector<std::jthread> workers;
+};